@@ -0,0 +1,201 @@
+#pragma once
+//Controllers that pick the moves of the computer-controlled paddle
+//A controller only sees a copy of the match, so heavier ones can run on a worker thread while the
+//frame thread keeps going with the last decision the worker finished
+#include "match.h"
+#include "metrics.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class AIController
+{
+public:
+	virtual ~AIController() {}
+	//Picks the next move of the enemy paddle, called with a snapshot of the match after a step
+	virtual AIDecision decide(const MatchState& match) = 0;
+};
+
+//The AI the game always had, following the ball
+class FollowBallController : public AIController
+{
+public:
+	FollowBallController(const AIParams& aiParams = AIParams()) : params(aiParams)
+	{
+	}
+
+	AIDecision decide(const MatchState& match)
+	{
+		return match.enemy.decideAI(match.ball.posx, match.ball.posy, params);
+	}
+
+private:
+	AIParams params;
+};
+
+//Simulates the ball ahead, bouncing it off the walls and the player's side, and heads to where it will
+//reach the enemy paddle instead of where it is now
+class PredictingController : public AIController
+{
+public:
+	//Simulation steps before giving up on a prediction, far more than the ball needs to cross the field twice
+	static const int MAX_STEPS = 4096;
+
+	PredictingController(const AIParams& aiParams = AIParams()) : params(aiParams)
+	{
+	}
+
+	AIDecision decide(const MatchState& match)
+	{
+		BallBody ball = match.ball;
+		//The ball is only simulated against the walls, the paddles are out of reach of this rectangle
+		PaddleRect nowhere = { -SCREEN_WIDTH, -SCREEN_HEIGHT, 0, 0 };
+		int enemyLine = match.enemy.rect.y + match.enemy.rect.h;
+		int playerLine = match.player.rect.y - ball.height;
+		for (int step = 0; step < MAX_STEPS; step++)
+		{
+			if (ball.vely < 0 && ball.posy <= enemyLine)
+				break;
+			//Assume the player returns the ball
+			if (ball.vely > 0 && ball.posy >= playerLine)
+				ball.vely = -ball.vely;
+			int events;
+			if (ball.move(1, nowhere, events) == -1)
+				break;
+		}
+		//Line the middle of the paddle up with the ball, at the speed the follow AI would use
+		AIDecision decision = match.enemy.decideAI(match.ball.posx, match.ball.posy, params);
+		int target = ball.posx + (ball.width >> 1) - (match.enemy.rect.w >> 1);
+		if (target < match.enemy.rect.x - decision.speed)
+			decision.direction = -1;
+		else if (target > match.enemy.rect.x + decision.speed)
+			decision.direction = 1;
+		else
+			decision.direction = 0;
+		return decision;
+	}
+
+private:
+	AIParams params;
+};
+
+//Feeds a controller the state after every step and hands back its decisions
+//Run synchronously the controller decides on the frame thread, run asynchronously it decides on a worker
+//and the frame never waits for it, moving with the last finished decision and counting it when it is stale
+class AIRunner
+{
+public:
+	AIRunner()
+	{
+		controller = NULL;
+		async = false;
+		running = false;
+		submitted = decided = matchStart = 0;
+		decision = { 0, 0 };
+		pending.reset();
+	}
+	~AIRunner()
+	{
+		stop();
+	}
+
+	void start(AIController* aiController, bool runAsync)
+	{
+		stop();
+		controller = aiController;
+		async = runAsync;
+		submitted = decided = matchStart = 0;
+		decision = { 0, 0 };
+		if (async)
+		{
+			running = true;
+			worker = std::thread(&AIRunner::run, this);
+		}
+	}
+
+	void stop()
+	{
+		if (!worker.joinable())
+			return;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			running = false;
+		}
+		submittedCondition.notify_one();
+		worker.join();
+	}
+
+	//Hands over the state the next decision is based on, call it after every step
+	void submit(const MatchState& match)
+	{
+		if (!async)
+		{
+			pending = match;
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			pending = match;
+			submitted++;
+		}
+		submittedCondition.notify_one();
+	}
+
+	//Hands over the first state of a match, decisions made for earlier matches are never used after it
+	void startMatch(const MatchState& match)
+	{
+		submit(match);
+		std::lock_guard<std::mutex> lock(mutex);
+		matchStart = submitted;
+	}
+
+	//Decision for the last submitted state, or asynchronously the latest one the worker finished
+	//The worker only holds the lock to swap states, so this never waits for a decision to be made
+	//Until the first decision of a match is ready the paddle stays where it is
+	AIDecision collect()
+	{
+		if (!async)
+			return controller->decide(pending);
+		std::lock_guard<std::mutex> lock(mutex);
+		if (decided < matchStart)
+			return { 0, 0 };
+		if (decided != submitted)
+			metrics.aiStaleDecisions.add();
+		return decision;
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			submittedCondition.wait(lock, [this] { return !running || decided != submitted; });
+			if (!running)
+				break;
+			//Decide on a copy so the frame can submit the next state in the meantime
+			MatchState snapshot = pending;
+			uint64_t sequence = submitted;
+			lock.unlock();
+			uint64_t start = metricsNowMicros();
+			AIDecision next = controller->decide(snapshot);
+			metrics.aiDecisionTime.record(metricsNowMicros() - start);
+			lock.lock();
+			decision = next;
+			decided = sequence;
+		}
+	}
+
+	AIController* controller;
+	bool async;
+	bool running;
+	//Guards everything below, shared with the worker
+	std::mutex mutex;
+	std::condition_variable submittedCondition;
+	MatchState pending;
+	uint64_t submitted, decided;
+	//Sequence of the first state of the current match
+	uint64_t matchStart;
+	AIDecision decision;
+	std::thread worker;
+};
@@ -0,0 +1,133 @@
+#pragma once
+//Per-frame arena for transient text and allocation counting for the frame loop
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+//Heap allocations made by the current thread, counted by the replaced operator new and SDL memory functions
+//Only the frame thread is of interest, so the counter is per thread and needs no atomics
+inline thread_local uint64_t threadAllocations = 0;
+
+//Marks the replaced allocation functions as never inlined
+#ifdef _MSC_VER
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline))
+#endif
+
+//Bump allocator for text formatted for a single frame
+//Everything formatted into it is released at once by reset at the start of the next frame
+class FrameArena
+{
+public:
+	static const size_t CAPACITY = 4096;
+
+	FrameArena()
+	{
+		used = 0;
+	}
+
+	void reset()
+	{
+		used = 0;
+	}
+
+	//Formats text like printf, truncating it if the arena runs out of space
+	const char* format(const char* text, ...)
+	{
+		if (used >= CAPACITY)
+			return "";
+		char* output = buffer + used;
+		size_t available = CAPACITY - used;
+		va_list args;
+		va_start(args, text);
+		int length = vsnprintf(output, available, text, args);
+		va_end(args);
+		if (length < 0)
+			return "";
+		used += (size_t)length + 1 < available ? (size_t)length + 1 : available;
+		return output;
+	}
+
+private:
+	char buffer[CAPACITY];
+	size_t used;
+};
+
+inline FrameArena frameArena;
+
+//Counts allocations made by each frame of a scene, ignoring the first frames while caches warm up
+//Frames where the game legitimately allocates, like saving the high score, can be excluded with ignoreFrame
+class AllocationTracker
+{
+public:
+	static const int WARMUP_FRAMES = 30;
+
+	AllocationTracker()
+	{
+		frameStart = 0;
+		warmup = 0;
+		ignored = false;
+		steadyFrames = 0;
+		allocatingFrames = 0;
+		worstFrame = 0;
+	}
+
+	void beginScene()
+	{
+		warmup = WARMUP_FRAMES;
+	}
+	void beginFrame()
+	{
+		frameStart = threadAllocations;
+		ignored = false;
+	}
+	void ignoreFrame()
+	{
+		ignored = true;
+	}
+
+	//Returns the number of allocations made since beginFrame
+	uint64_t endFrame()
+	{
+		uint64_t count = threadAllocations - frameStart;
+		if (warmup > 0)
+		{
+			warmup--;
+			return count;
+		}
+		if (ignored)
+			return count;
+		steadyFrames++;
+		if (count > 0)
+		{
+			allocatingFrames++;
+			if (count > worstFrame)
+				worstFrame = count;
+		}
+		return count;
+	}
+
+	//Number of steady state frames that allocated
+	uint64_t getAllocatingFrames()
+	{
+		return allocatingFrames;
+	}
+	uint64_t getSteadyFrames()
+	{
+		return steadyFrames;
+	}
+	uint64_t getWorstFrame()
+	{
+		return worstFrame;
+	}
+
+private:
+	uint64_t frameStart;
+	int warmup;
+	bool ignored;
+	uint64_t steadyFrames;
+	uint64_t allocatingFrames;
+	uint64_t worstFrame;
+};
@@ -0,0 +1,383 @@
+#pragma once
+//Automated load harness that drives the real game loop with scripted input
+//The game runs on SDL's dummy video driver and disk audio driver, the harness pushes menu clicks,
+//paddle movement and pause toggles through SDL_PushEvent and measures every presented frame
+//
+//Every frame the game tells the harness which screen it is on, the script reacts to that
+//Time is virtual while the harness runs: every presented frame advances the game clock by 16 ms,
+//so the physics behave the same no matter how fast the dummy renderer is
+#include <SDL.h>
+#include "allocation.h"
+#include "metrics.h"
+#include "scene.h"
+#include <cstdio>
+#include <random>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <unistd.h>
+#endif
+
+//Buttons the script clicks
+enum HarnessTarget
+{
+	TARGET_PLAY, TARGET_OPTIONS, TARGET_HIGH_SCORE, TARGET_CREDITS, TARGET_BACK, TARGET_COUNT
+};
+
+//Resident memory of the process in kilobytes, 0 where it cannot be measured
+inline long residentMemoryKB()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return (long)(counters.WorkingSetSize / 1024);
+	return 0;
+#else
+	long pages = 0, resident = 0;
+	FILE* statm = fopen("/proc/self/statm", "r");
+	if (statm == NULL)
+		return 0;
+	if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(statm);
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#endif
+}
+
+class LoadHarness
+{
+public:
+	//Milliseconds the virtual clock advances on every presented frame
+	static const Uint32 FRAME_MILLIS = 16;
+
+	LoadHarness() : frameTimes("harness_frame_time", "")
+	{
+		active = false;
+		targetMatches = 0;
+		matchesDone = 0;
+		lastScene = SCENE_MENU;
+		sceneSteps = 0;
+		clock = 0;
+		frames = 0;
+		lastFrameMicros = 0;
+		mouseX = mouseY = 0;
+		for (int i = 0; i < SDL_NUM_SCANCODES; i++)
+			keys[i] = 0;
+		for (int i = 0; i < TARGET_COUNT; i++)
+			targets[i] = { 0, 0 };
+		direction = 0;
+		nextDirectionChange = 0;
+		nextPause = 0;
+		pauses = 0;
+		lastTour = -1;
+		screensToVisit = 0;
+		matchFrames = 0;
+		liveTextures = 0;
+		maxTextures = 0;
+		for (int i = 0; i < Histogram::BUCKETS; i++)
+			matchStartCounts[i] = 0;
+	}
+
+	//Selects the dummy drivers, must be called before SDL_Init
+	void start(int matches)
+	{
+		active = true;
+		targetMatches = matches;
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 1);
+		SDL_setenv("SDL_AUDIODRIVER", "disk", 1);
+#ifdef _WIN32
+		SDL_setenv("SDL_DISKAUDIOFILE", "NUL", 1);
+#else
+		SDL_setenv("SDL_DISKAUDIOFILE", "/dev/null", 1);
+#endif
+		//One sample per match plus the start and the end, reserved so measuring never allocates mid-run
+		samples.reserve(matches + 2);
+		random.seed(1);
+	}
+
+	bool isActive()
+	{
+		return active;
+	}
+
+	//Center of a button the script clicks
+	void setTarget(HarnessTarget target, const SDL_Rect& rect)
+	{
+		targets[target] = { rect.x + rect.w / 2, rect.y + rect.h / 2 };
+	}
+
+	//Called before the events of a frame are polled, pushes the scripted input for the screen the game is on
+	void inject(Scene scene)
+	{
+		if (scene != lastScene)
+		{
+			lastScene = scene;
+			sceneSteps = 0;
+			if (scene == SCENE_PAUSED)
+				pauses++;
+		}
+		sceneSteps++;
+
+		switch (scene)
+		{
+		case SCENE_MENU:
+			if (sceneSteps != 2)
+				break;
+			if (matchesDone >= targetMatches)
+			{
+				SDL_Event quit;
+				SDL_zero(quit);
+				quit.type = SDL_QUIT;
+				SDL_PushEvent(&quit);
+			}
+			else
+			{
+				//Every tenth match the script looks around the other screens first
+				if (matchesDone % 10 == 0 && lastTour != matchesDone)
+				{
+					lastTour = matchesDone;
+					screensToVisit = 3;
+				}
+				if (screensToVisit > 0)
+				{
+					//Options, then high score, then credits
+					click(targets[TARGET_OPTIONS + 3 - screensToVisit]);
+					screensToVisit--;
+					break;
+				}
+				click(targets[TARGET_PLAY]);
+				startMatch();
+			}
+			break;
+		case SCENE_OPTIONS:
+		case SCENE_CREDITS:
+		case SCENE_HIGH_SCORE:
+			if (sceneSteps == 10)
+				click(targets[TARGET_BACK]);
+			break;
+		case SCENE_PLAY:
+			matchFrames++;
+			//Hold A, D or nothing for a random number of frames
+			if (matchFrames >= nextDirectionChange)
+			{
+				setKey(SDL_SCANCODE_A, SDLK_a, false);
+				setKey(SDL_SCANCODE_D, SDLK_d, false);
+				direction = (int)(random() % 3) - 1;
+				if (direction < 0)
+					setKey(SDL_SCANCODE_A, SDLK_a, true);
+				else if (direction > 0)
+					setKey(SDL_SCANCODE_D, SDLK_d, true);
+				nextDirectionChange = matchFrames + 10 + (int)(random() % 50);
+			}
+			if (matchFrames == nextPause)
+				setKey(SDL_SCANCODE_P, SDLK_p, true);
+			break;
+		case SCENE_PAUSED:
+			//Release P, then press and release it again to resume
+			if (sceneSteps == 10 || sceneSteps == 30)
+				setKey(SDL_SCANCODE_P, SDLK_p, false);
+			else if (sceneSteps == 20)
+				setKey(SDL_SCANCODE_P, SDLK_p, true);
+			break;
+		case SCENE_MATCH_OVER:
+			if (sceneSteps == 5)
+			{
+				setKey(SDL_SCANCODE_A, SDLK_a, false);
+				setKey(SDL_SCANCODE_D, SDLK_d, false);
+				matchesDone++;
+				sample();
+				click(targets[TARGET_PLAY]);
+				startMatch();
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	//Called after every presented frame
+	void onFrame(int textures)
+	{
+		uint64_t now = metricsNowMicros();
+		if (frames > 0)
+			frameTimes.record(now - lastFrameMicros);
+		lastFrameMicros = now;
+		frames++;
+		clock += FRAME_MILLIS;
+		liveTextures = textures;
+		if (textures > maxTextures)
+			maxTextures = textures;
+		if (samples.empty())
+			sample();
+	}
+
+	Uint32 getTicks()
+	{
+		return clock;
+	}
+	const Uint8* getKeyboardState()
+	{
+		return keys;
+	}
+	void getMouseState(int* x, int* y)
+	{
+		*x = mouseX;
+		*y = mouseY;
+	}
+
+	//Prints the summary and writes one line per match to reportPath, returns false if the game leaked textures
+	bool report(const char* reportPath)
+	{
+		sample();
+		FILE* file = reportPath != NULL ? fopen(reportPath, "w") : NULL;
+		if (file != NULL)
+			fprintf(file, "match,frames,frame_p50_us,frame_p99_us,frame_max_us,rss_kb,textures,allocations\n");
+		for (size_t i = 0; file != NULL && i < samples.size(); i++)
+		{
+			const Sample& s = samples[i];
+			fprintf(file, "%d,%llu,%llu,%llu,%llu,%ld,%d,%llu\n", s.match, (unsigned long long)s.frames, (unsigned long long)s.p50,
+				(unsigned long long)s.p99, (unsigned long long)s.max, s.residentKB, s.textures, (unsigned long long)s.allocations);
+		}
+		if (file != NULL)
+			fclose(file);
+
+		//Textures loaded by the first match and the screens visited before it are expected to stay alive
+		const Sample& first = samples.size() > 1 ? samples[1] : samples.front();
+		const Sample& last = samples.back();
+		printf("Harness played %d matches over %llu frames, pausing %d times\n", matchesDone, (unsigned long long)frames, pauses);
+		printf("Frame time p50 %llu us, p99 %llu us, max %llu us\n", (unsigned long long)quantile(0.5, NULL),
+			(unsigned long long)quantile(0.99, NULL), (unsigned long long)quantile(1.0, NULL));
+		printf("Resident memory %ld KB -> %ld KB\n", first.residentKB, last.residentKB);
+		printf("Live textures after the first match %d, at the end %d, at most %d\n", first.textures, last.textures, maxTextures);
+		printf("Allocations on the game thread %llu\n", (unsigned long long)(last.allocations - first.allocations));
+		return last.textures <= first.textures;
+	}
+
+private:
+	struct Point
+	{
+		int x, y;
+	};
+
+	//Statistics at the end of a match, frame times only cover that match
+	struct Sample
+	{
+		int match;
+		uint64_t frames;
+		uint64_t p50, p99, max;
+		long residentKB;
+		int textures;
+		uint64_t allocations;
+	};
+
+	//Scripted matches last about 90 frames, the ball first reaches the player after about 55, so the pause
+	//comes before that and every match pauses once
+	void startMatch()
+	{
+		direction = 0;
+		nextDirectionChange = 20;
+		nextPause = 20 + (int)(random() % 30);
+		matchFrames = 0;
+	}
+
+	void click(Point point)
+	{
+		mouseX = point.x;
+		mouseY = point.y;
+		SDL_Event e;
+		SDL_zero(e);
+		e.type = SDL_MOUSEMOTION;
+		e.motion.x = point.x;
+		e.motion.y = point.y;
+		SDL_PushEvent(&e);
+		SDL_zero(e);
+		e.type = SDL_MOUSEBUTTONDOWN;
+		e.button.button = SDL_BUTTON_LEFT;
+		e.button.state = SDL_PRESSED;
+		e.button.x = point.x;
+		e.button.y = point.y;
+		SDL_PushEvent(&e);
+	}
+
+	void setKey(int scancode, SDL_Keycode key, bool down)
+	{
+		if ((keys[scancode] != 0) == down)
+			return;
+		keys[scancode] = down ? 1 : 0;
+		SDL_Event e;
+		SDL_zero(e);
+		e.type = down ? SDL_KEYDOWN : SDL_KEYUP;
+		e.key.state = down ? SDL_PRESSED : SDL_RELEASED;
+		e.key.keysym.scancode = (SDL_Scancode)scancode;
+		e.key.keysym.sym = key;
+		SDL_PushEvent(&e);
+	}
+
+	//Quantile of the frame times, since the last match when since is given
+	uint64_t quantile(double q, const uint64_t* since)
+	{
+		uint64_t sum, total = 0;
+		frameTimes.snapshot(quantileCounts, sum);
+		for (int i = 0; i < Histogram::BUCKETS; i++)
+		{
+			if (since != NULL)
+				quantileCounts[i] -= since[i];
+			total += quantileCounts[i];
+		}
+		uint64_t target = (uint64_t)(q * total + 0.5), seen = 0;
+		for (int i = 0; i < Histogram::BUCKETS; i++)
+		{
+			seen += quantileCounts[i];
+			if (seen >= target && seen > 0)
+				return Histogram::bucketUpperBound(i);
+		}
+		return 0;
+	}
+
+	void sample()
+	{
+		Sample s;
+		s.match = matchesDone;
+		s.frames = frames;
+		s.p50 = quantile(0.5, matchStartCounts);
+		s.p99 = quantile(0.99, matchStartCounts);
+		s.max = quantile(1.0, matchStartCounts);
+		s.residentKB = residentMemoryKB();
+		s.textures = liveTextures;
+		s.allocations = threadAllocations;
+		if (samples.size() < samples.capacity())
+			samples.push_back(s);
+		uint64_t sum;
+		frameTimes.snapshot(matchStartCounts, sum);
+	}
+
+	bool active;
+	int targetMatches;
+	int matchesDone;
+	Scene lastScene;
+	int sceneSteps;
+	Uint32 clock;
+	uint64_t frames;
+	uint64_t lastFrameMicros;
+	int mouseX, mouseY;
+	Uint8 keys[SDL_NUM_SCANCODES];
+	Point targets[TARGET_COUNT];
+	int direction;
+	int nextDirectionChange;
+	int nextPause;
+	int pauses;
+	int lastTour;
+	int screensToVisit;
+	int matchFrames;
+	int liveTextures;
+	int maxTextures;
+	Histogram frameTimes;
+	uint64_t matchStartCounts[Histogram::BUCKETS];
+	//Scratch space of quantile, owned by each harness so reports never share it
+	uint64_t quantileCounts[Histogram::BUCKETS];
+	std::vector<Sample> samples;
+	std::mt19937 random;
+};
@@ -3,11 +3,20 @@
 #include <SDL_ttf.h>
 #include <SDL_mixer.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string>
 #include <fstream>
-
-const int SCREEN_WIDTH = 600;
-const int SCREEN_HEIGHT = 800;
+#include <new>
+#include "aicontroller.h"
+#include "allocation.h"
+#include "harness.h"
+#include "match.h"
+#include "matchhistory.h"
+#include "metrics.h"
+#include "scene.h"
+#include "spectator.h"
+#include "statehash.h"
+#include "ui.h"
 
 int musicvolume = 128;
 int fxvolume = 128;
@@ -22,8 +31,133 @@ Mix_Chunk* buttonHover = NULL;
 //clickSound will be used to play a sound when clicking
 Mix_Chunk* clickSound = NULL;
 
+//Tracks allocations made by gameplay frames
+AllocationTracker allocationTracker;
+
+//Count every heap allocation made by the game, SDL allocations are counted by the functions below
+//Kept out of line so the compiler never pairs an inlined malloc with a delete expression
+NOINLINE void* operator new(size_t size)
+{
+	threadAllocations++;
+	void* memory = malloc(size ? size : 1);
+	if (memory == NULL)
+		throw std::bad_alloc();
+	return memory;
+}
+NOINLINE void operator delete(void* memory) noexcept
+{
+	free(memory);
+}
+NOINLINE void operator delete(void* memory, size_t) noexcept
+{
+	free(memory);
+}
+
+SDL_malloc_func sdlMalloc;
+SDL_calloc_func sdlCalloc;
+SDL_realloc_func sdlRealloc;
+SDL_free_func sdlFree;
+
+void* countingMalloc(size_t size)
+{
+	threadAllocations++;
+	return sdlMalloc(size);
+}
+void* countingCalloc(size_t count, size_t size)
+{
+	threadAllocations++;
+	return sdlCalloc(count, size);
+}
+void* countingRealloc(void* memory, size_t size)
+{
+	threadAllocations++;
+	return sdlRealloc(memory, size);
+}
+
+//Routes SDL and its libraries through the counting functions, must be called before SDL allocates anything
+void countSDLAllocations()
+{
+	SDL_GetMemoryFunctions(&sdlMalloc, &sdlCalloc, &sdlRealloc, &sdlFree);
+	SDL_SetMemoryFunctions(countingMalloc, countingCalloc, countingRealloc, sdlFree);
+}
+
+//Scripted input and measurements, only active when started with --harness
+LoadHarness harness;
+//Textures currently alive, reported by the harness to catch leaks
+int liveTextures = 0;
+
+//Polls the events of a frame, letting the harness push its scripted input for the current screen first
+void pollFrameEvents(FrameEvents& events, Scene scene)
+{
+	if (harness.isActive())
+		harness.inject(scene);
+	events.count = 0;
+	while (events.count < FrameEvents::MAX_EVENTS && SDL_PollEvent(&events.events[events.count]) != 0)
+		events.count++;
+}
+
+//Game clock in milliseconds, virtual under the harness
+Uint32 getTicks()
+{
+	if (harness.isActive())
+		return harness.getTicks();
+	return SDL_GetTicks();
+}
+
+const Uint8* keyboardState()
+{
+	if (harness.isActive())
+		return harness.getKeyboardState();
+	return SDL_GetKeyboardState(NULL);
+}
+
+void getMouseState(int* x, int* y)
+{
+	if (harness.isActive())
+		harness.getMouseState(x, y);
+	else
+		SDL_GetMouseState(x, y);
+}
+
+//Plays a sound effect on the first free channel
+void playSound(Mix_Chunk* sound)
+{
+	metrics.soundsTriggered.add();
+	Mix_PlayChannel(-1, sound, 0);
+}
+
+//Starts a screen's widgets from the current mouse position, the only time the UI reads the mouse state
+void enterUI(UILayer& layer)
+{
+	int x, y;
+	getMouseState(&x, &y);
+	layer.reset(x, y);
+}
+
+//Passes an event to a screen's widgets and plays the hover and click sounds
+UIInput handleUI(UILayer& layer, const SDL_Event& event)
+{
+	UIInput input = layer.handleEvent(event);
+	if (input.entered >= 0)
+		playSound(buttonHover);
+	if (input.clicked >= 0)
+		playSound(clickSound);
+	return input;
+}
+
+//Presents the frame, timing how long the renderer blocks
+void presentFrame()
+{
+	{
+		ScopedTimer timer(metrics.presentTime);
+		SDL_RenderPresent(renderer);
+	}
+	if (harness.isActive())
+		harness.onFrame(liveTextures);
+}
+
 //Dimensions for the information tab
-SDL_Rect infoTab = { 0,0,SCREEN_WIDTH,80 };
+SDL_Rect infoTab = { 0,0,SCREEN_WIDTH,INFO_TAB_HEIGHT };
 
 //Function that will be used to render the info tab rectangle above the game screen during gameplay
 void infoTabRender()
@@ -50,6 +184,7 @@ public:
 		if (texture != NULL)
 		{
 			SDL_DestroyTexture(texture);
+			liveTextures--;
 			texture = NULL;
 			width = 0;
 			height = 0;
@@ -62,27 +197,31 @@ public:
 	}
 
 	//Loads image at specified path
-	void loadFromFile(std::string path, bool transparent = false)
+	void loadFromFile(const char* path, bool transparent = false)
 	{
 		free();
 		//Load image at specified path
-		SDL_Surface* surface = IMG_Load(path.c_str());
+		SDL_Surface* surface = IMG_Load(path);
 
 		//Set transparent color
 		SDL_SetColorKey(surface, transparent, SDL_MapRGB(surface->format, 0xFF, 0x0, 0x0));
 		texture = SDL_CreateTextureFromSurface(renderer, surface);
+		if (texture != NULL)
+			liveTextures++;
 		width = surface->w;
 		height = surface->h;
 		SDL_FreeSurface(surface);
 	}
 
 	//Loads text into the texture
-	void loadFromRenderedText(std::string textureText, SDL_Color textColor, TTF_Font* font)
+	void loadFromRenderedText(const char* textureText, SDL_Color textColor, TTF_Font* font)
 	{
 		free();
 		//Render text surface
-		SDL_Surface* textSurface = TTF_RenderText_Solid(font, textureText.c_str(), textColor);
+		SDL_Surface* textSurface = TTF_RenderText_Solid(font, textureText, textColor);
 		texture = SDL_CreateTextureFromSurface(renderer, textSurface);
+		if (texture != NULL)
+			liveTextures++;
 		width = textSurface->w;
 		height = textSurface->h;
 		SDL_FreeSurface(textSurface);
@@ -123,6 +262,72 @@ private:
 };
 
 
+//Text made of a fixed prefix followed by a number
+//The prefix and every digit are rendered once, so a changing number never creates textures during gameplay
+class NumberText
+{
+public:
+	void load(const char* prefix, SDL_Color textColor, TTF_Font* font)
+	{
+		prefixTexture.loadFromRenderedText(prefix, textColor, font);
+		char digit[2] = { '0', 0 };
+		for (int i = 0; i < 10; i++)
+		{
+			digit[0] = (char)('0' + i);
+			digits[i].loadFromRenderedText(digit, textColor, font);
+		}
+	}
+
+	int getWidth(int number)
+	{
+		int text[12];
+		int length = toDigits(number, text);
+		int width = prefixTexture.getWidth();
+		for (int i = 0; i < length; i++)
+			width += digits[text[i]].getWidth();
+		return width;
+	}
+
+	void render(int x, int y, int number)
+	{
+		int text[12];
+		int length = toDigits(number, text);
+		prefixTexture.render(x, y);
+		x += prefixTexture.getWidth();
+		for (int i = 0; i < length; i++)
+		{
+			digits[text[i]].render(x, y);
+			x += digits[text[i]].getWidth();
+		}
+	}
+
+	void free()
+	{
+		prefixTexture.free();
+		for (int i = 0; i < 10; i++)
+			digits[i].free();
+	}
+
+private:
+	//Splits a non negative number into digit values, most significant first
+	int toDigits(int number, int* text)
+	{
+		int reversed[12];
+		int length = 0;
+		do
+		{
+			reversed[length++] = number % 10;
+			number /= 10;
+		} while (number > 0 && length < 11);
+		for (int i = 0; i < length; i++)
+			text[i] = reversed[length - 1 - i];
+		return length;
+	}
+
+	wTexture prefixTexture;
+	wTexture digits[10];
+};
+
 //Initialize SDL library subsystems as well as the global variables
 void init()
 {
@@ -159,6 +364,7 @@ void close()
 	SDL_Quit();
 }
 
+//Sprites in the order of the widget states
 enum ButtonSprite
 {
 	BUTTON_SPRITE_MOUSE_OUT = 0,
@@ -173,11 +379,9 @@ public:
 	Button()
 	{
 		Position.x = Position.y = 0; BUTTON_WIDTH = BUTTON_HEIGHT = 0;
-		CurrentSprite = BUTTON_SPRITE_MOUSE_OUT;
-		lastEventWasInside = false;
 	}
 	//Load target text 3 times with different colors for different button states
-	void loadText(std::string text, TTF_Font* font)
+	void loadText(const char* text, TTF_Font* font)
 	{
 		sprites[BUTTON_SPRITE_MOUSE_OUT].loadFromRenderedText(text, { 0x0, 0x0, 0x0 }, font);
 		sprites[BUTTON_SPRITE_MOUSE_OVER_MOTION].loadFromRenderedText(text, { 0xFF, 0xFF, 0xFF }, font);
@@ -196,59 +400,13 @@ public:
 		for (int i = 0; i < BUTTON_SPRITE_TOTAL; i++)
 			sprites[i].~wTexture();
 	}
-	//Check if mouse is hovering or pressing the button
-	bool handleEvent(SDL_Event* e)
-	{
-		bool clicked = false;
-		int x, y;
-		//Check mouse position
-		SDL_GetMouseState(&x, &y);
-		bool inside = true;
-		if (x < Position.x)
-			inside = false;
-		else if (x > Position.x + BUTTON_WIDTH)
-			inside = false;
-
-		else if (y < Position.y)
-			inside = false;
-		else if (y > Position.y + BUTTON_HEIGHT)
-			inside = false;
-		if (!inside) {
-			CurrentSprite = BUTTON_SPRITE_MOUSE_OUT;
-			lastEventWasInside = false;
-		}
-		else
-		{
-			switch (e->type)
-			{
-			case SDL_MOUSEMOTION:
-				CurrentSprite = BUTTON_SPRITE_MOUSE_OVER_MOTION;
-				if (!lastEventWasInside)
-					Mix_PlayChannel(-1, buttonHover, 0);
-				lastEventWasInside = true;
-
-				break;
-
-			case SDL_MOUSEBUTTONDOWN:
-				CurrentSprite = BUTTON_SPRITE_MOUSE_DOWN;
-				Mix_PlayChannel(-1, clickSound, 0);
-				clicked = true;
-				break;
-			}
-			const Uint8* currentKeyStates = SDL_GetKeyboardState(NULL);
-			if (currentKeyStates[SDL_SCANCODE_SPACE])
-			{
-				CurrentSprite = BUTTON_SPRITE_MOUSE_DOWN;
-				Mix_PlayChannel(-1, clickSound, 0);
-				clicked = true;
-			}
-
-		}
-		return clicked;
-	}
-	void render()
+	//Draws the sprite for the state the button has in its UI layer
+	void render(WidgetState state)
 	{
-		sprites[CurrentSprite].render(Position.x, Position.y);
+		sprites[state].render(Position.x, Position.y);
+	}
+	SDL_Rect getRect() {
+		return { Position.x, Position.y, BUTTON_WIDTH, BUTTON_HEIGHT };
 	}
 	int getWidth() {
 		return BUTTON_WIDTH;
@@ -260,36 +418,22 @@ public:
 
 private:
 	SDL_Point Position;
-	ButtonSprite CurrentSprite;
 	wTexture sprites[BUTTON_SPRITE_TOTAL];
 	int BUTTON_WIDTH;
 	int BUTTON_HEIGHT;
-	bool lastEventWasInside;
 };
 
-//Calculated the squared distance between to points in a 2d space
-//The function will be used to compare distances so there is no need to calculate the square root
-int distanceSquared(int x1, int y1, int x2, int y2)
-{
-	int deltaX = x2 - x1;
-	int deltaY = y2 - y1;
-	return deltaX * deltaX + deltaY * deltaY;
-}
-
+//Draws the ball of a match and plays its sounds, the ball itself lives in the match state
 class Ball
 {
 public:
-	Ball() {
+	Ball(BallBody& ballBody) : body(ballBody) {
 		ballTexture.loadFromFile("sprites/ball.png", true);
-		posx = 300; posy = 300;
-		speed = 2;
-		radius = ballTexture.getHeight() >> 1;
-		vely = speed;
-		velx = speed;
+		body.reset(ballTexture.getWidth(), ballTexture.getHeight());
 	}
 	void render()
 	{
-		ballTexture.render(posx, posy);
+		ballTexture.render(body.posx, body.posy);
 	}
 	//Deallocates ball texture;
 	void free()
@@ -297,172 +441,75 @@ public:
 		ballTexture.free();
 	}
 
-	int move(int ticks, SDL_Rect* rect) {
-		int prevX = posx, prevY = posy;
-		const Uint8* currentKeyStates = SDL_GetKeyboardState(NULL);
-		posy += vely * ticks;
-		
-		//If the ball hits a wall negate velocity direction and play a sound
-		if (posy < 80) {
-			Mix_PlayChannel(-1, buttonHover, 0);
-			return -1;
-		}
-		if (posy > SCREEN_HEIGHT - 15 - ballTexture.getHeight()) {
-			Mix_PlayChannel(-1, clickSound, 0);
-			return -1;
-		}
-
-		posx += velx * ticks;
-		if (posx < 0 || posx > SCREEN_WIDTH - ballTexture.getWidth()) {
-			velx = -velx;
-			posx += velx;
-			Mix_PlayChannel(-1, buttonHover, 0);
-		}
-
-		//Save output of isColliding to not have to calculate it several times
-		int collisionTest = isColliding(rect);
-
-		//If the ball hit the player
-		if (collisionTest > 0) {
-
-			posx = prevX;
-			posy = prevY;
-			vely = -vely;
-			//If the ball hit the vertical side of the player box horizontal velocity will also be negated
-			if (collisionTest > 1) {
-				velx = -velx;
-				posx += 2 * velx * ticks;
-				posy += 2 * vely * ticks;
-			}
-			Mix_PlayChannel(-1, buttonHover, 0);
-			return 1;
-		}
-		return 0;
-	}
-
-	int isColliding(SDL_Rect* rect)
-	{
-		//Compute center of ball
-		int centerX = posx + (ballTexture.getWidth() >> 1);
-		int centerY = posy + (ballTexture.getHeight() >> 1);
-		int offsetX;
-		int offsetY;
-
-		//Will determine if the collision happened on the vertical side of the box
-		int sideCollision = 0;
-
-		//Closest point on x axis
-		if (centerX < rect->x) {
-			offsetX = rect->x;
-			sideCollision = 1;
+	//Plays a sound for whatever the ball hit during a step, events being the BallEvent flags of the move
+	void playSounds(int events) {
+		//If the ball hits a wall play a sound
+		if (events & BALL_EVENT_OUT_TOP)
+			playSound(buttonHover);
+		if (events & BALL_EVENT_OUT_BOTTOM)
+			playSound(clickSound);
+		if (events & BALL_EVENT_WALL) {
+			metrics.collisions.add();
+			playSound(buttonHover);
 		}
-		else if (centerX > rect->x + rect->w)
-		{
-			offsetX = rect->x + rect->w;
-			sideCollision = 1;
+		if (events & BALL_EVENT_PADDLE) {
+			metrics.collisions.add();
+			playSound(buttonHover);
 		}
-		else offsetX = centerX;
-
-		//Closest point on y axis
-		if (centerY < rect->y)
-			offsetY = rect->y;
-		else if (centerY > rect->y + rect->h)
-			offsetY = rect->y + rect->h;
-		else offsetY = centerY;
-
-		//Check if distance between closest point is smaller than the radius 
-		//Squaring instead of calculating sqrt is significantly faster
-		if (distanceSquared(centerX, centerY, offsetX, offsetY) < radius * radius)
-		{
-			return 1 + sideCollision;
-		}
-		return 0;
 	}
 
 	void setPos(int x, int y)
 	{
-		posx = x;
-		posy = y;
+		body.posx = x;
+		body.posy = y;
 	}
 
-	int getPosx() { return posx; } int getPosy() { return posy; }
-	int getVely() { return vely; }
-	void resetVely() { vely = speed; }
+	int getPosx() { return body.posx; } int getPosy() { return body.posy; }
+	int getVely() { return body.vely; }
+	void resetVely() { body.vely = body.speed; }
 private:
 	wTexture ballTexture;
-	int posx, posy;
-	int speed;
-	int radius;
-	int velx, vely;
+	BallBody& body;
 };
 
+//Controls and draws a paddle of the match state
 class Player
 {
 public:
 
-	Player(int y)
+	Player(PaddleBody& paddleBody, int y) : body(paddleBody)
 	{
-		Rect = { SCREEN_WIDTH / 4, y, 80, 20 };
+		body.reset(y);
 	}
 
 	//Control the player box with A and D to move horizontally
 	void move(int ticks)
 	{
-		const Uint8* currentKeyStates = SDL_GetKeyboardState(NULL);
+		const Uint8* currentKeyStates = keyboardState();
 		if (currentKeyStates[SDL_SCANCODE_A])
-		{
-			Rect.x -= speed * ticks;
-			if (Rect.x < 0)
-				Rect.x = 0;
-
-		}
+			body.move(ticks, -1);
 		else if (currentKeyStates[SDL_SCANCODE_D])
-		{
-			Rect.x += speed * ticks;
-			if (Rect.x > SCREEN_WIDTH - Rect.w)
-				Rect.x = SCREEN_WIDTH - Rect.w;
-		}
+			body.move(ticks, 1);
 	}
-	//Function to move computer-controlled enemy
-	//Simple AI consisting of following the ball with a speed inversely proportional to the distance
-	//between the ball and the enemy
-	void moveAI(int ticks, int ballx, int bally, int speedy)
-	{
-		speed = 3;
-		int distanceCoefficient;
-		if ((bally > 750 || bally < 80))
-			distanceCoefficient = 0;
-		else
-			distanceCoefficient = (SCREEN_HEIGHT - 50 - bally + 80);
-		if (ballx < Rect.x)
-		{
-			Rect.x -= (speed + distanceCoefficient >> 7) * ticks;
-			if (Rect.x < 0)
-				Rect.x = 0;
-
-		}
-		else if (ballx > Rect.x + Rect.w)
-		{
-			Rect.x += (speed + distanceCoefficient >> 7) * ticks;
-			if (Rect.x > SCREEN_WIDTH - Rect.w)
-				Rect.x = SCREEN_WIDTH - Rect.w;
-		}
+	//Moves the computer-controlled enemy as its controller decided
+	void moveAI(int ticks, const AIDecision& decision)
+	{
+		body.applyAI(ticks, decision);
 	}
 	//Render player texture on screen
 	void render()
 	{
+		SDL_Rect rect = { body.rect.x, body.rect.y, body.rect.w, body.rect.h };
 		SDL_SetRenderDrawColor(renderer, 0x0, 0x0, 0x0, 0xFF);
-		SDL_RenderFillRect(renderer, &Rect);
+		SDL_RenderFillRect(renderer, &rect);
 	}
 	//Get collision box
-	SDL_Rect* getRect() {
-		return &Rect;
+	const PaddleRect& getRect() {
+		return body.rect;
 	}
 
 private:
-	SDL_Rect Rect;
-	int xVel, yVel;
-	int speed = 2;
+	PaddleBody& body;
 };
 
 enum Buttons {
@@ -472,6 +519,7 @@ enum Buttons {
 //Checks if the score is higher than the previous record and update it
 bool updateScore(int score)
 {
+	ScopedTimer timer(metrics.updateScoreTime);
 	std::string line;
 	int record[3], i = 0;
 	std::ifstream scores;
@@ -495,16 +543,86 @@ bool updateScore(int score)
 	}
 	return false;
 }
+//Spectators watching this game, the host only runs when started with --broadcast
+SpectatorHost spectatorHost;
+bool broadcasting = false;
 
-
+//Simulation state of the match, drawn by the ball and paddle objects but owned here so copying it is free
+MatchState match;
+//The last few seconds of the match, saved every step for rewinding and rollback
+MatchHistory<256> matchHistory;
 
 int main(int argc, char* args[])
 {
+	//Optional Prometheus metrics file, rewritten every few seconds while the game runs
+	MetricsExporter metricsExporter;
+	std::string metricsPath;
+	int metricsInterval = 10;
+	//When set, the exit code reports gameplay frames that allocated after warming up
+	bool failOnAllocation = false;
+	//Broadcast port and bandwidth budget per spectator in bytes per second
+	int broadcastPort = 0, broadcastBudget = 4096;
+	//The broadcast stays on this machine unless it is explicitly opened to the network
+	bool broadcastPublic = false;
+	//Address of the host to watch instead of playing
+	std::string spectateAddress;
+	//Hash of the match state after every step, written to a trace file to detect desyncs
+	StateTraceWriter stateTrace;
+	//Matches the load harness plays before quitting, 0 to play normally, and where it writes its report
+	int harnessMatches = 0;
+	std::string harnessReport;
+	//Controller of the enemy paddle, optionally deciding on a worker thread
+	FollowBallController followController;
+	PredictingController predictingController;
+	AIController* enemyController = &followController;
+	bool asyncAI = false;
+	AIRunner enemyAI;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = args[i];
+		if (arg == "--metrics" && i + 1 < argc)
+			metricsPath = args[++i];
+		else if (arg == "--metrics-interval" && i + 1 < argc)
+			metricsInterval = std::stoi(args[++i]);
+		else if (arg == "--fail-on-alloc")
+			failOnAllocation = true;
+		else if (arg == "--broadcast" && i + 1 < argc)
+			broadcastPort = std::stoi(args[++i]);
+		else if (arg == "--broadcast-budget" && i + 1 < argc)
+			broadcastBudget = std::stoi(args[++i]);
+		else if (arg == "--broadcast-public")
+			broadcastPublic = true;
+		else if (arg == "--spectate" && i + 1 < argc)
+			spectateAddress = args[++i];
+		else if (arg == "--trace" && i + 1 < argc && !stateTrace.open(args[++i]))
+			printf("Failed to open trace file %s\n", args[i]);
+		else if (arg == "--harness" && i + 1 < argc)
+			harnessMatches = std::stoi(args[++i]);
+		else if (arg == "--harness-report" && i + 1 < argc)
+			harnessReport = args[++i];
+		else if (arg == "--ai" && i + 1 < argc)
+		{
+			std::string name = args[++i];
+			if (name == "predict")
+				enemyController = &predictingController;
+			else if (name != "follow")
+				printf("Unknown AI %s, using follow\n", name.c_str());
+		}
+		else if (arg == "--ai-async")
+			asyncAI = true;
+	}
+	//The harness picks the dummy drivers, so it has to start before SDL is initialized
+	if (harnessMatches > 0)
+		harness.start(harnessMatches);
+	enemyAI.start(enemyController, asyncAI);
+	if (!metricsPath.empty())
+		metricsExporter.start(metricsPath, metricsInterval);
+
+	countSDLAllocations();
 	init();
 	Mix_PlayMusic(music, -1);
 	bool quit = false;
-	SDL_Event e;
-	wTexture mainMenu, scoreText, textHolder;
+	wTexture mainMenu;
 
 	//Load background
 	mainMenu.loadFromFile("sprites/mainMenu.png");
@@ -517,6 +635,27 @@ int main(int argc, char* args[])
 	//Black color for font
 	SDL_Color textColor = { 0x0, 0x0, 0x0 };
 
+	//Text shown during gameplay is rendered once up front so the game loop does not create textures
+	NumberText scoreText;
+	wTexture pauseHint, pausedText, winText, loseText, newHighScoreText;
+	scoreText.load("SCORE:", textColor, infoFont);
+	pauseHint.loadFromRenderedText("P-PAUSE", textColor, infoFont);
+	pausedText.loadFromRenderedText("PAUSED", textColor, infoFontLarge);
+	winText.loadFromRenderedText("YOU WIN", textColor, infoFontLarge);
+	loseText.loadFromRenderedText("YOU LOSE", textColor, infoFontLarge);
+	newHighScoreText.loadFromRenderedText("NEW HIGH SCORE!", { 0xFF,0,0 }, font40);
+
+	//Text of the other screens never changes either, only the high score values do
+	wTexture sfxVolumeText, musicVolumeText, creditsRoleText, creditsNameText, highScoreLabels[3], highScoreValues[3];
+	sfxVolumeText.loadFromRenderedText("SFX volume:", textColor, font40);
+	musicVolumeText.loadFromRenderedText("Music volume:", textColor, font40);
+	creditsRoleText.loadFromRenderedText("Programming & Music", textColor, infoFont);
+	creditsNameText.loadFromRenderedText("Moraru Alexandru", textColor, infoFont);
+	for (int i = 0; i < 3; i++)
+		highScoreLabels[i].loadFromRenderedText(frameArena.format("No. %d:", i + 1), textColor, font68);
+	//Values the high score textures show, -1 until they are first rendered
+	int shownRecord[3] = { -1, -1, -1 };
+
 
 	//Declaring button array
 	Button buttons[TOTAL_BUTTONS], backButton, musicInc, musicDec, fxInc, fxDec, sourceCode;
@@ -540,345 +679,450 @@ int main(int argc, char* args[])
 	for (int i = 0; i < TOTAL_BUTTONS; ++i)
 		buttons[i].setPosition((SCREEN_WIDTH - buttons[i].getWidth()) / 2, (i == 0) ? 280 : 300 + 60 * i);
 	backButton.setPosition(20, 20);
+	harness.setTarget(TARGET_PLAY, buttons[PLAY].getRect());
+	harness.setTarget(TARGET_OPTIONS, buttons[OPTIONS].getRect());
+	harness.setTarget(TARGET_HIGH_SCORE, buttons[HIGH_SCORE].getRect());
+	harness.setTarget(TARGET_CREDITS, buttons[CREDITS].getRect());
+	harness.setTarget(TARGET_BACK, backButton.getRect());
 	musicInc.setPosition(370, 455);
 	musicDec.setPosition(470, 450);
 	fxInc.setPosition(370, 375);
 	fxDec.setPosition(470, 370);
 
+	//Widgets of every screen are registered once, the main menu ids follow the Buttons enum
+	UILayer menuUI, playUI, optionsUI, creditsUI, highScoreUI;
+	for (int i = 0; i < TOTAL_BUTTONS; ++i)
+		menuUI.add(buttons[i].getRect());
+	int playBack = playUI.add(backButton.getRect());
+	int optionsBack = optionsUI.add(backButton.getRect());
+	int optionsFxInc = optionsUI.add(fxInc.getRect()), optionsFxDec = optionsUI.add(fxDec.getRect());
+	int optionsMusicInc = optionsUI.add(musicInc.getRect()), optionsMusicDec = optionsUI.add(musicDec.getRect());
+	int creditsBack = creditsUI.add(backButton.getRect());
+	int creditsSource = creditsUI.add(sourceCode.getRect());
+	int highScoreBack = highScoreUI.add(backButton.getRect());
+
 	//Initializing player and enemy with their positions
-	Player player(SCREEN_HEIGHT - 50), enemy(110);
-	Ball ball;
+	Player player(match.player, SCREEN_HEIGHT - 50), enemy(match.enemy, 110);
+	Ball ball(match.ball);
+
+	if (broadcastPort > 0)
+	{
+		broadcasting = spectatorHost.start((Uint16)broadcastPort, broadcastBudget, broadcastPublic);
+		if (!broadcasting)
+			printf("Failed to open broadcast port %d\n", broadcastPort);
+	}
+
+	//Every screen below is a coroutine resumed once per frame by the loop at the end of main
+	//They capture the locals of main by reference, which outlive them since the loop runs until the last one returns
+	SceneScheduler scheduler;
+
+	//Draws the playing field, the paddles and the ball as they are now
+	auto renderField = [&]()
+	{
+		SDL_SetRenderDrawColor(renderer, 0x0, 0xFF, 0xBF, 0xFF);
+		SDL_RenderClear(renderer);
+
+		//Render info tab above 
+		infoTabRender();
+		scoreText.render(SCREEN_WIDTH - scoreText.getWidth(match.score) - 10, 20, match.score);
+		pauseHint.render(SCREEN_WIDTH - scoreText.getWidth(match.score) - 250, 20);
+		backButton.render(playUI.getState(playBack));
+		player.render();
+		enemy.render();
+		ball.render();
+	};
+
+	//Spectating only draws the match received from the host, there is no menu
+	auto spectateScene = [&]() -> SceneTask
+	{
+		SpectatorClient spectatorClient;
+		if (!spectatorClient.connect(spectateAddress.c_str()))
+		{
+			printf("Cannot spectate %s\n", spectateAddress.c_str());
+			co_return;
+		}
+		wTexture waitingText;
+		waitingText.loadFromRenderedText("WAITING FOR MATCH", textColor, infoFont);
+		while (!quit)
+		{
+			spectatorClient.update();
+			const SpectatorState& state = spectatorClient.getState();
+
+			if (!spectatorClient.hasState() || state.fields[FIELD_PHASE] == PHASE_MENU)
+			{
+				SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+				SDL_RenderClear(renderer);
+				mainMenu.render(0, 0);
+				waitingText.render((SCREEN_WIDTH - waitingText.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5);
+			}
+			else
+			{
+				SDL_SetRenderDrawColor(renderer, 0x0, 0xFF, 0xBF, 0xFF);
+				SDL_RenderClear(renderer);
+				infoTabRender();
+				int spectatedScore = state.fields[FIELD_SCORE];
+				scoreText.render(SCREEN_WIDTH - scoreText.getWidth(spectatedScore) - 10, 20, spectatedScore);
+				SDL_Rect paddles[2] = {
+					{ state.fields[FIELD_PLAYER_X], state.fields[FIELD_PLAYER_Y], state.fields[FIELD_PLAYER_W], state.fields[FIELD_PLAYER_H] },
+					{ state.fields[FIELD_ENEMY_X], state.fields[FIELD_ENEMY_Y], state.fields[FIELD_ENEMY_W], state.fields[FIELD_ENEMY_H] }
+				};
+				SDL_SetRenderDrawColor(renderer, 0x0, 0x0, 0x0, 0xFF);
+				SDL_RenderFillRects(renderer, paddles, 2);
+				ball.setPos(state.fields[FIELD_BALL_X], state.fields[FIELD_BALL_Y]);
+				ball.render();
+				if (state.fields[FIELD_PHASE] == PHASE_OVER)
+				{
+					wTexture& result = state.fields[FIELD_PLAYER_HIT_BALL] ? winText : loseText;
+					result.render((SCREEN_WIDTH - result.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5);
+				}
+			}
+			co_await scheduler.nextFrame(SCENE_SPECTATE);
+		}
+		waitingText.free();
+	};
+
+	//Holds the field still until P is released and then released again
+	auto pauseScene = [&]() -> SceneTask
+	{
+		playSound(clickSound);
+		bool released = false;
+		while (true)
+		{
+			renderField();
+			pausedText.render((SCREEN_WIDTH - pausedText.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5);
+			const FrameEvents& events = co_await scheduler.nextFrame(SCENE_PAUSED);
+			if (quit)
+			{
+				match.lost = true;
+				co_return;
+			}
+			for (const SDL_Event& event : events)
+				if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_p)
+				{
+					if (released)
+					{
+						playSound(clickSound);
+						co_return;
+					}
+					released = true;
+				}
+		}
+	};
+
+	//Shows who won until the player clicks to go back to the main menu
+	auto matchOverScene = [&]() -> SceneTask
+	{
+		//Update high score, harness runs leave the operator's high score table alone
+		bool newHighScore = !harness.isActive() && updateScore(match.score);
+		//If the last one to hit the ball was the player display "you win" message
+		wTexture& result = match.playerHitBall ? winText : loseText;
+		while (true)
+		{
+			renderField();
+			result.render((SCREEN_WIDTH - result.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5);
+			if (newHighScore)
+				newHighScoreText.render((SCREEN_WIDTH - newHighScoreText.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5 + 125);
+			const FrameEvents& events = co_await scheduler.nextFrame(SCENE_MATCH_OVER);
+			if (quit)
+				co_return;
+			for (const SDL_Event& event : events)
+				if (event.type == SDL_MOUSEBUTTONDOWN)
+				{
+					playSound(clickSound);
+					co_return;
+				}
+		}
+	};
+
+	//MAIN GAME LOOP
+	auto playScene = [&]() -> SceneTask
+	{
+		//Initialize game parameters
+		ball.resetVely();
+		match.playerHitBall = false;
+		//Will be used to calculate frame duration for time-based physics
+		Uint32 lastFrameTicks = getTicks();
+		allocationTracker.beginScene();
+		enemyAI.startMatch(match);
+		matchHistory.clear();
+		enterUI(playUI);
+
+		while (!match.lost)
+		{
+			//Calculating time for each frame so that physics is time based instead
+			//of FPS based
+			Uint32 currentFrameTicks = getTicks();
+			int tickDifference = currentFrameTicks - lastFrameTicks;
+			lastFrameTicks = currentFrameTicks;
+
+			//Calculating ticks passed to feed into move function
+
+			//Binary shift to right instead of dividing to save time
+			player.move(tickDifference >> 2);
+
+			//AI moves with the decision its controller made on the state after the last frame
+			enemy.moveAI(tickDifference >> 2, enemyAI.collect());
+
+			//The ball, score and last hitter advance through the same rules the environment library uses
+			int ballEvents;
+			int ballState = match.moveBall(tickDifference >> 2, ballEvents);
+			ball.playSounds(ballEvents);
+
+			//If ball went out of bounds
+			if (ballState == -1)
+			{
+				match.lost = true;
+				metrics.matchesPlayed.add();
+				//Saving the high score reads and writes a file, which is not part of the steady state
+				allocationTracker.ignoreFrame();
+			}
+			if (stateTrace.isOpen())
+				stateTrace.record(match);
+			matchHistory.save(match);
+			//Spectators get the state once the step updated the score and the last hitter
+			if (broadcasting)
+				spectatorHost.publish(toSpectatorState(match, ballState == -1 ? PHASE_OVER : PHASE_PLAY));
+			//Submitted before presenting so an asynchronous controller decides while the frame is shown
+			enemyAI.submit(match);
+			if (ballState == -1)
+			{
+				co_await matchOverScene();
+				co_return;
+			}
+			renderField();
+
+			const FrameEvents& events = co_await scheduler.nextFrame(SCENE_PLAY);
+			if (quit)
+				co_return;
+			bool paused = false;
+			for (const SDL_Event& event : events)
+			{
+				if (handleUI(playUI, event).clicked == playBack)
+					match.lost = true;
+				//P will pause the game until it is pressed again
+				if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_p)
+					paused = true;
+			}
+			if (paused && !match.lost)
+			{
+				allocationTracker.ignoreFrame();
+				co_await pauseScene();
+				lastFrameTicks = getTicks();
+			}
+		}
+	};
+
+	auto optionsScene = [&]() -> SceneTask
+	{
+		enterUI(optionsUI);
+		while (true)
+		{
+			//Render the options screen
+			SDL_RenderClear(renderer);
+			mainMenu.render(0, 0);
+			backButton.render(optionsUI.getState(optionsBack));
+			SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+			sfxVolumeText.render((SCREEN_WIDTH - sfxVolumeText.getWidth()) / 2 - 100, 300 + 80);
+			musicVolumeText.render((SCREEN_WIDTH - musicVolumeText.getWidth()) / 2 - 100, 300 + 160);
+
+			musicInc.render(optionsUI.getState(optionsMusicInc));
+			musicDec.render(optionsUI.getState(optionsMusicDec));
+			fxInc.render(optionsUI.getState(optionsFxInc));
+			fxDec.render(optionsUI.getState(optionsFxDec));
+
+			const FrameEvents& events = co_await scheduler.nextFrame(SCENE_OPTIONS);
+			if (quit)
+				co_return;
+			for (const SDL_Event& event : events)
+			{
+				int clicked = handleUI(optionsUI, event).clicked;
+				if (clicked == optionsBack)
+					co_return;
+				//Handle events for sound and music volume buttons
+				if (clicked == optionsFxInc)
+				{
+					if (fxvolume < 128)
+						fxvolume += 16;
+					Mix_Volume(-1, fxvolume);
+				}
+				if (clicked == optionsFxDec)
+				{
+					if (fxvolume > 0)
+						fxvolume -= 16;
+					Mix_Volume(-1, fxvolume);
+				}
+				if (clicked == optionsMusicInc)
+				{
+					if (musicvolume < 128)
+						musicvolume += 16;
+					Mix_VolumeMusic(musicvolume);
+				}
+				if (clicked == optionsMusicDec)
+				{
+					if (musicvolume > 0)
+						musicvolume -= 16;
+					Mix_VolumeMusic(musicvolume / 2);
+				}
+			}
+		}
+	};
+
+	auto creditsScene = [&]() -> SceneTask
+	{
+		enterUI(creditsUI);
+		while (true)
+		{
+			SDL_RenderClear(renderer);
+			mainMenu.render(0, 0);
+			backButton.render(creditsUI.getState(creditsBack));
+			creditsRoleText.render((SCREEN_WIDTH - creditsRoleText.getWidth()) / 2, 350);
+			creditsNameText.render((SCREEN_WIDTH - creditsNameText.getWidth()) / 2, 450);
+			sourceCode.render(creditsUI.getState(creditsSource));
+
+			const FrameEvents& events = co_await scheduler.nextFrame(SCENE_CREDITS);
+			if (quit)
+				co_return;
+			for (const SDL_Event& event : events)
+			{
+				int clicked = handleUI(creditsUI, event).clicked;
+				if (clicked == creditsBack)
+					co_return;
+				//Source code button links to the github repo page
+				if (clicked == creditsSource)
+					SDL_OpenURL("https://github.com/alexmru/pong");
+			}
+		}
+	};
 
-	//Will be used to calculate frame duration for time-based physics
-	int tickDifference, currentFrameTicks, lastFrameTicks;
+	auto highScoreScene = [&]() -> SceneTask
+	{
+		std::string line;
+		int record[3] = { 0, 0, 0 }, i = 0;
+		std::ifstream scores;
+		//Open the score text file that holds the high scores
+		scores.open("score/score.txt");
+		while (i < 3 && getline(scores, line))
+		{
+			record[i] = std::stoi(line);
+			i++;
+		}
+		//Scores only change after a match, so their textures are rendered again only when they differ
+		for (i = 0; i < 3; i++)
+			if (record[i] != shownRecord[i])
+			{
+				highScoreValues[i].loadFromRenderedText(frameArena.format("%d", record[i]), { 0xFF,0x0,0x0 }, font68);
+				shownRecord[i] = record[i];
+			}
+		enterUI(highScoreUI);
+		while (true)
+		{
+			SDL_RenderClear(renderer);
+			SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
+			mainMenu.render(0, 0);
+			backButton.render(highScoreUI.getState(highScoreBack));
+			for (i = 0; i < 3; i++) {
+				highScoreLabels[i].render((SCREEN_WIDTH - highScoreLabels[i].getWidth()) / 2 - 100, 300 + 80 * i);
+				highScoreValues[i].render((SCREEN_WIDTH - highScoreValues[i].getWidth()) / 2 + 150, 300 + 80 * i);
+			}
 
-	bool lost;
-	int score;
-	bool playerHitBall;
-	int ballState;
+			const FrameEvents& events = co_await scheduler.nextFrame(SCENE_HIGH_SCORE);
+			if (quit)
+				co_return;
+			for (const SDL_Event& event : events)
+				if (handleUI(highScoreUI, event).clicked == highScoreBack)
+					co_return;
+		}
+	};
 
-	//While quit flag is not active, keep looping
-	while (!quit)
+	auto renderMenu = [&]()
 	{
-		lost = false;
-		ball.setPos(300, 300);
-		score = 0;
 		SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
 		SDL_RenderClear(renderer);
 
 		//Render main menu 
 		mainMenu.render(0, 0);
 		for (int i = 0; i < TOTAL_BUTTONS; ++i)
-			buttons[i].render();
-		SDL_RenderPresent(renderer);
+			buttons[i].render(menuUI.getState(i));
+	};
 
-		//Handle input
-		while (SDL_PollEvent(&e) != 0)
+	auto menuScene = [&]() -> SceneTask
+	{
+		while (!quit)
 		{
+			match.lost = false;
+			ball.setPos(300, 300);
+			match.score = 0;
+			renderMenu();
+			if (broadcasting)
+				spectatorHost.publish(toSpectatorState(match, PHASE_MENU));
+
+			//Handle input
+			const FrameEvents& events = co_await scheduler.nextFrame(SCENE_MENU);
+			int clicked = -1;
+			for (const SDL_Event& event : events)
+			{
+				//Check if any button was clicked
+				UIInput input = handleUI(menuUI, event);
+				if (clicked < 0)
+					clicked = input.clicked;
+			}
 
-			//User requests quit
-			if (e.type == SDL_QUIT)
+			//The events belong to this frame only, so the chosen screen runs after they were all handled
+			switch (clicked)
 			{
+			case PLAY:
+				co_await playScene();
+				break;
+			case OPTIONS:
+				co_await optionsScene();
+				break;
+			case CREDITS:
+				co_await creditsScene();
+				break;
+			case HIGH_SCORE:
+				co_await highScoreScene();
+				break;
+			case QUIT:
+				//Give the click sound a few frames to play before closing
+				for (int i = 0; i < 12; i++)
+				{
+					renderMenu();
+					co_await scheduler.nextFrame(SCENE_MENU);
+				}
 				quit = true;
+				break;
 			}
-			
-			//Check if any button was clicked
-			for (int i = 0; i < TOTAL_BUTTONS; ++i)
-				if (buttons[i].handleEvent(&e))
-					switch (i)
-					{
-						//MAIN GAME LOOP
-					case PLAY:
-						//Initialize game parameters
-						ball.resetVely();
-						playerHitBall = false;
-						lastFrameTicks = SDL_GetTicks();
-
-						while (!lost)
-						{
-
-							currentFrameTicks = SDL_GetTicks();
-							//Calculating time for each frame so that physics is time based instead
-							//of FPS based
-							tickDifference = currentFrameTicks - lastFrameTicks;
-							lastFrameTicks = currentFrameTicks;
-							//Keep polling events on queue
-							if (SDL_PollEvent(&e) != 0)
-							{
-								//If user closes window set quit flag to true
-								if (e.type == SDL_QUIT)
-								{
-									quit = true;
-									break;
-								}
-								if (backButton.handleEvent(&e))
-									lost = true;
-
-								//P will pause the game by entering a loop that is exited when p is pressed again
-								if (e.key.keysym.sym == SDLK_p)
-								{
-									Mix_PlayChannel(-1, clickSound, 0);
-									textHolder.loadFromRenderedText("PAUSED", textColor, infoFontLarge);
-									textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5);
-									SDL_RenderPresent(renderer);
-									bool released = false;
-									if (e.type == SDL_KEYDOWN) {
-										while (e.type != SDL_KEYUP)
-										{
-											SDL_PollEvent(&e);
-										}
-										while (1)
-										{
-											SDL_PollEvent(&e);
-											if (e.key.keysym.sym == SDLK_p && e.type == SDL_KEYUP) {
-												Mix_PlayChannel(-1, clickSound, 0);
-												break;
-											}
-											if (e.type == SDL_QUIT)
-											{
-												lost = true;
-												quit = true;
-												break;
-											}
-										}
-
-										lastFrameTicks = SDL_GetTicks();
-									}
-
-								}
-
-							}
-							SDL_SetRenderDrawColor(renderer, 0x0, 0xFF, 0xBF, 0xFF);
-							SDL_RenderClear(renderer);
-
-							//Render info tab above 
-							infoTabRender();
-							scoreText.loadFromRenderedText("SCORE:" + std::to_string(score), textColor, infoFont);
-							scoreText.render(SCREEN_WIDTH - scoreText.getWidth() - 10, 20);
-							textHolder.loadFromRenderedText("P-PAUSE",textColor,infoFont);
-							textHolder.render(SCREEN_WIDTH - scoreText.getWidth() - 250, 20);
-							backButton.render();
-
-
-							//Calculating ticks passed to feed into move function
-
-							//Binary shift to right instead of dividing to save time
-							player.move(tickDifference >> 2);
-
-							player.render();
-
-							//AI moves depending on ball coordinates
-							enemy.moveAI(tickDifference >> 2, ball.getPosx(), ball.getPosy(), ball.getVely());
-							enemy.render();
-
-							//Ball will alternate on checking collision with player and enemy based on last one to hit the ball
-							//This simple optimization will allow the ball to check collision for only one rectangle
-							if (playerHitBall)
-								ballState = ball.move(tickDifference >> 2, enemy.getRect());
-							else
-								ballState = ball.move(tickDifference >> 2, player.getRect());
-							
-							//The move function will determine the state of the ball
-							switch (ballState)
-							{
-							//If ball went out of bounds
-							case -1:
-								lost = true;
-								//If the last one to hit the ball was the player display "you win" message
-								if (playerHitBall) {
-									textHolder.loadFromRenderedText("YOU WIN", textColor, infoFontLarge);
-									textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5);
-									//Update score
-									if (updateScore(score))
-									{
-										textHolder.loadFromRenderedText("NEW HIGH SCORE!", { 0xFF,0,0 }, font40);
-										textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5 + 125);
-									}
-									SDL_RenderPresent(renderer);
-									
-
-									//Click to go back to main menu
-									while (1) {
-										SDL_PollEvent(&e);
-										if (e.type == SDL_MOUSEBUTTONDOWN)
-										{
-											Mix_PlayChannel(-1, clickSound, 0);
-											break;
-										}
-										if (e.type == SDL_QUIT)
-										{
-											lost = true;
-											quit = true;
-											break;
-										}
-									}
-								}
-								else
-								{
-									//Display you lose message
-									textHolder.loadFromRenderedText("YOU LOSE", textColor, infoFontLarge);
-									textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5);
-
-									//Update high score
-									if (updateScore(score))
-									{
-										textHolder.loadFromRenderedText("NEW HIGH SCORE!", { 0xFF,0,0 }, font40);
-										textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2, SCREEN_HEIGHT * 2 / 5 + 125);
-									}
-									SDL_RenderPresent(renderer);
-
-									//Click to go back to main menu
-									while (1) {
-										SDL_PollEvent(&e);
-										if (e.type == SDL_MOUSEBUTTONDOWN)
-										{
-											Mix_PlayChannel(-1, clickSound, 0);
-											break;
-										}
-										if (e.type == SDL_QUIT)
-										{
-											lost = true;
-											quit = true;
-											break;
-										}
-									}
-								}
-
-								break;
-							//If player hit the ball increment score
-							case 1:
-								if (!playerHitBall)
-									score++;
-								playerHitBall = !playerHitBall; break;
-							}
-							ball.render();
-							SDL_RenderPresent(renderer);
-
-						}
-						break;
-
-					case OPTIONS:
-
-						while (!backButton.handleEvent(&e))
-						{
-							//Quit if player closes the window
-							SDL_PollEvent(&e);
-							if (e.type == SDL_QUIT)
-							{
-								quit = true; break;
-							}
-							//Handle events for sound and music volume buttons
-							if (fxInc.handleEvent(&e))
-							{
-								if (fxvolume < 128)
-									fxvolume += 16;
-								Mix_Volume(-1, fxvolume);
-							}
-							if (fxDec.handleEvent(&e))
-							{
-								if (fxvolume > 0)
-									fxvolume -= 16;
-								Mix_Volume(-1, fxvolume);
-							}
-							if (musicInc.handleEvent(&e))
-							{
-								if (musicvolume < 128)
-									musicvolume += 16;
-								Mix_VolumeMusic(musicvolume);
-							}
-							if (musicDec.handleEvent(&e))
-							{
-								if (musicvolume > 0)
-									musicvolume -= 16;
-								Mix_VolumeMusic(musicvolume / 2);
-							}
-
-							//Render the options screen
-							SDL_RenderClear(renderer);
-							mainMenu.render(0, 0);
-							backButton.render();
-							SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-							textHolder.loadFromRenderedText("SFX volume:", textColor, font40);
-							textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2 - 100, 300 + 80);
-							textHolder.loadFromRenderedText("Music volume:", textColor, font40);
-							textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2 - 100, 300 + 160);
-
-							musicInc.render();
-							musicDec.render();
-							fxInc.render();
-							fxDec.render();
-
-							SDL_RenderPresent(renderer);
-						}
-						break;
-					case CREDITS:
-					{
-						while (!backButton.handleEvent(&e))
-						{
-							SDL_PollEvent(&e);
-							if (e.type == SDL_QUIT)
-							{
-								quit = true; break;
-							}
-
-							//Source code button links to the github repo page
-							if (sourceCode.handleEvent(&e))
-								SDL_OpenURL("https://github.com/alexmru/pong");
-
-							SDL_RenderClear(renderer);
-							mainMenu.render(0, 0);
-							backButton.render();
-							textHolder.loadFromRenderedText("Programming & Music", textColor, infoFont);
-							textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2, 350);
-							textHolder.loadFromRenderedText("Moraru Alexandru", textColor, infoFont);
-							textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2, 450);
-
-							sourceCode.render();
-							SDL_RenderPresent(renderer);
-						}
-					}
-
-					case HIGH_SCORE:
-					{
-						std::string line;
-						int record[3], i = 0;
-						std::ifstream scores;
-						//Open the score text file that holds the high scores
-						scores.open("score/score.txt");
-						while (getline(scores, line))
-						{
-							record[i] = std::stoi(line);
-							i++;
-						}
-						while (!backButton.handleEvent(&e))
-						{
-							SDL_PollEvent(&e);
-							if (e.type == SDL_QUIT)
-							{
-								quit = true; break;
-							}
-							SDL_RenderClear(renderer);
-							SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF);
-							mainMenu.render(0, 0);
-							backButton.render();
-							for (i = 0; i < 3; i++) {
-								textHolder.loadFromRenderedText("No. " + std::to_string(i + 1) + ":", textColor, font68);
-								textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2 - 100, 300 + 80 * i);
-								textHolder.loadFromRenderedText(std::to_string(record[i]), { 0xFF,0x0,0x0 }, font68);
-								textHolder.render((SCREEN_WIDTH - textHolder.getWidth()) / 2 + 150, 300 + 80 * i);
-							}
-							SDL_RenderPresent(renderer);
-						}
-						break;
-					}
-					case QUIT:
-						quit = true;
-						SDL_Delay(200);
-						break;
-					}
-
+			//The mouse is somewhere else after another screen
+			if (clicked >= 0)
+				enterUI(menuUI);
 		}
-		
+	};
+
+	//The one frame loop of the game: poll, let the current scene update and render, present
+	SceneTask rootScene = spectateAddress.empty() ? menuScene() : spectateScene();
+	scheduler.start(rootScene);
+	FrameEvents frameEvents;
+	uint64_t lastFrameMicros = metricsNowMicros();
+	while (!scheduler.isDone())
+	{
+		frameArena.reset();
+		//Only gameplay frames are expected to be allocation free, menus load text textures
+		bool trackAllocations = scheduler.getScene() == SCENE_PLAY;
+		if (trackAllocations)
+			allocationTracker.beginFrame();
+		uint64_t currentFrameMicros = metricsNowMicros();
+		metrics.frameTime.record(currentFrameMicros - lastFrameMicros);
+		lastFrameMicros = currentFrameMicros;
+
+		pollFrameEvents(frameEvents, scheduler.getScene());
+		for (const SDL_Event& event : frameEvents)
+			//User requests quit, every scene returns on the next frame it gets
+			if (event.type == SDL_QUIT)
+				quit = true;
+		scheduler.runFrame(frameEvents);
+		presentFrame();
+		if (trackAllocations)
+			metrics.frameAllocations.record(allocationTracker.endFrame());
 	}
 	//Deallocating fonts
 	TTF_CloseFont(font40);
@@ -892,10 +1136,30 @@ int main(int argc, char* args[])
 	backButton.free(); musicInc.free(); musicDec.free();  fxInc.free(); fxDec.free(); sourceCode.free();
 
 	//Deallocating textures
-	mainMenu.free(); scoreText.free(); textHolder.free();
+	mainMenu.free();
+	sfxVolumeText.free(); musicVolumeText.free(); creditsRoleText.free(); creditsNameText.free();
+	for (int i = 0; i < 3; i++)
+	{
+		highScoreLabels[i].free();
+		highScoreValues[i].free();
+	}
+	scoreText.free(); pauseHint.free(); pausedText.free(); winText.free(); loseText.free(); newHighScoreText.free();
 	ball.free();
 	//Deallocating memory for global objects
 	close();
+
+	//The harness report is written before any exit code is picked so a failing run still leaves it behind
+	bool texturesLeaked = harness.isActive() && !harness.report(harnessReport.empty() ? NULL : harnessReport.c_str());
+	if (allocationTracker.getAllocatingFrames() > 0)
+	{
+		printf("%llu of %llu steady state frames allocated, at most %llu allocations in one frame\n",
+			(unsigned long long)allocationTracker.getAllocatingFrames(), (unsigned long long)allocationTracker.getSteadyFrames(),
+			(unsigned long long)allocationTracker.getWorstFrame());
+		if (failOnAllocation)
+			return 3;
+	}
+	if (texturesLeaked)
+		return 4;
 	return 0;
 }
 
@@ -0,0 +1,294 @@
+#pragma once
+//Rules of the match without any rendering or audio
+//Shared by the game and the headless environment library so both simulate exactly the same physics
+#include <type_traits>
+
+const int SCREEN_WIDTH = 600;
+const int SCREEN_HEIGHT = 800;
+
+//Height of the info tab above the playing field
+const int INFO_TAB_HEIGHT = 80;
+
+//Dimensions of sprites/ball.png, used when the match runs without loading textures
+const int BALL_SIZE = 13;
+
+//Flags reporting what happened to the ball during a move, used by the game to pick sounds
+enum BallEvent
+{
+	BALL_EVENT_NONE = 0,
+	BALL_EVENT_WALL = 1,
+	BALL_EVENT_PADDLE = 2,
+	BALL_EVENT_OUT_TOP = 4,
+	BALL_EVENT_OUT_BOTTOM = 8
+};
+
+//Calculated the squared distance between to points in a 2d space
+//The function will be used to compare distances so there is no need to calculate the square root
+inline int distanceSquared(int x1, int y1, int x2, int y2)
+{
+	int deltaX = x2 - x1;
+	int deltaY = y2 - y1;
+	return deltaX * deltaX + deltaY * deltaY;
+}
+
+//Collision box with the same layout as SDL_Rect
+struct PaddleRect
+{
+	int x, y, w, h;
+};
+
+struct BallBody
+{
+	int posx, posy;
+	int speed;
+	int width, height;
+	int radius;
+	int velx, vely;
+
+	void reset(int spriteWidth = BALL_SIZE, int spriteHeight = BALL_SIZE)
+	{
+		posx = 300; posy = 300;
+		speed = 2;
+		width = spriteWidth;
+		height = spriteHeight;
+		radius = height >> 1;
+		vely = speed;
+		velx = speed;
+	}
+
+	//Returns -1 if the ball left the field, 1 if it hit the paddle and 0 otherwise
+	int move(int ticks, const PaddleRect& rect, int& events)
+	{
+		int prevX = posx, prevY = posy;
+		events = BALL_EVENT_NONE;
+		posy += vely * ticks;
+
+		//If the ball leaves the field through the top or the bottom the match is over
+		if (posy < INFO_TAB_HEIGHT) {
+			events |= BALL_EVENT_OUT_TOP;
+			return -1;
+		}
+		if (posy > SCREEN_HEIGHT - 15 - height) {
+			events |= BALL_EVENT_OUT_BOTTOM;
+			return -1;
+		}
+
+		//If the ball hits a wall negate velocity direction
+		posx += velx * ticks;
+		if (posx < 0 || posx > SCREEN_WIDTH - width) {
+			velx = -velx;
+			posx += velx;
+			events |= BALL_EVENT_WALL;
+		}
+
+		//Save output of isColliding to not have to calculate it several times
+		int collisionTest = isColliding(rect);
+
+		//If the ball hit the player
+		if (collisionTest > 0) {
+
+			posx = prevX;
+			posy = prevY;
+			vely = -vely;
+			//If the ball hit the vertical side of the player box horizontal velocity will also be negated
+			if (collisionTest > 1) {
+				velx = -velx;
+				posx += 2 * velx * ticks;
+				posy += 2 * vely * ticks;
+			}
+			events |= BALL_EVENT_PADDLE;
+			return 1;
+		}
+		return 0;
+	}
+
+	int isColliding(const PaddleRect& rect) const
+	{
+		//Compute center of ball
+		int centerX = posx + (width >> 1);
+		int centerY = posy + (height >> 1);
+		int offsetX;
+		int offsetY;
+
+		//Will determine if the collision happened on the vertical side of the box
+		int sideCollision = 0;
+
+		//Closest point on x axis
+		if (centerX < rect.x) {
+			offsetX = rect.x;
+			sideCollision = 1;
+		}
+		else if (centerX > rect.x + rect.w)
+		{
+			offsetX = rect.x + rect.w;
+			sideCollision = 1;
+		}
+		else offsetX = centerX;
+
+		//Closest point on y axis
+		if (centerY < rect.y)
+			offsetY = rect.y;
+		else if (centerY > rect.y + rect.h)
+			offsetY = rect.y + rect.h;
+		else offsetY = centerY;
+
+		//Check if distance between closest point is smaller than the radius
+		//Squaring instead of calculating sqrt is significantly faster
+		if (distanceSquared(centerX, centerY, offsetX, offsetY) < radius * radius)
+		{
+			return 1 + sideCollision;
+		}
+		return 0;
+	}
+};
+
+//Coefficients of the computer-controlled paddle, the defaults are the ones the game ships with
+struct AIParams
+{
+	//Base speed of the paddle
+	int speed = 3;
+	//The distance coefficient is shifted right by this much, a smaller value makes the paddle faster
+	int distanceShift = 7;
+};
+
+//Move an AI picked for the next frame, applied by whoever advances the match
+struct AIDecision
+{
+	//-1 for left, 1 for right and 0 to stay
+	int direction;
+	//Distance moved per tick
+	int speed;
+};
+
+struct PaddleBody
+{
+	PaddleRect rect;
+	int speed;
+
+	void reset(int y)
+	{
+		rect = { SCREEN_WIDTH / 4, y, 80, 20 };
+		speed = 2;
+	}
+
+	//Moves the paddle horizontally, direction is -1 for left, 1 for right and 0 to stay
+	void move(int ticks, int direction)
+	{
+		if (direction < 0)
+		{
+			rect.x -= speed * ticks;
+			if (rect.x < 0)
+				rect.x = 0;
+
+		}
+		else if (direction > 0)
+		{
+			rect.x += speed * ticks;
+			if (rect.x > SCREEN_WIDTH - rect.w)
+				rect.x = SCREEN_WIDTH - rect.w;
+		}
+	}
+
+	//Simple AI consisting of following the ball with a speed inversely proportional to the distance
+	//between the ball and the enemy
+	//bally is measured as seen from the top of the field, see mirroredY for a paddle at the bottom
+	void moveAI(int ticks, int ballx, int bally, const AIParams& params = AIParams())
+	{
+		speed = params.speed;
+		applyAI(ticks, decideAI(ballx, bally, params));
+	}
+
+	//Decision moveAI takes, split out so controllers can pick it away from the frame
+	AIDecision decideAI(int ballx, int bally, const AIParams& params = AIParams()) const
+	{
+		int distanceCoefficient;
+		if ((bally > 750 || bally < 80))
+			distanceCoefficient = 0;
+		else
+			distanceCoefficient = (SCREEN_HEIGHT - 50 - bally + 80);
+		AIDecision decision = { 0, (params.speed + distanceCoefficient) >> params.distanceShift };
+		if (ballx < rect.x)
+			decision.direction = -1;
+		else if (ballx > rect.x + rect.w)
+			decision.direction = 1;
+		return decision;
+	}
+
+	void applyAI(int ticks, const AIDecision& decision)
+	{
+		if (decision.direction < 0)
+		{
+			rect.x -= decision.speed * ticks;
+			if (rect.x < 0)
+				rect.x = 0;
+
+		}
+		else if (decision.direction > 0)
+		{
+			rect.x += decision.speed * ticks;
+			if (rect.x > SCREEN_WIDTH - rect.w)
+				rect.x = SCREEN_WIDTH - rect.w;
+		}
+	}
+};
+
+//Everything that changes during a match
+//Plain data only, so a copy is a memcpy and render resources live elsewhere
+struct MatchState
+{
+	BallBody ball;
+	PaddleBody player, enemy;
+	int score;
+	bool playerHitBall;
+	//Set once the ball left the field or the player went back to the menu
+	bool lost;
+
+	void reset()
+	{
+		ball.reset();
+		player.reset(SCREEN_HEIGHT - 50);
+		enemy.reset(110);
+		score = 0;
+		playerHitBall = false;
+		lost = false;
+	}
+
+	//Advances the match by one frame the same way the game loop does
+	//Returns the ball state, -1 meaning the match is over and won if playerHitBall is set
+	int step(int ticks, int playerDirection, int& events)
+	{
+		player.move(ticks, playerDirection);
+		enemy.moveAI(ticks, ball.posx, ball.posy);
+		return moveBall(ticks, events);
+	}
+
+	//Same as step but with the player paddle also controlled by the AI, used for self-play
+	int stepAI(int ticks, const AIParams& playerAI, const AIParams& enemyAI, int& events)
+	{
+		player.moveAI(ticks, ball.posx, mirroredY(ball.posy), playerAI);
+		enemy.moveAI(ticks, ball.posx, ball.posy, enemyAI);
+		return moveBall(ticks, events);
+	}
+
+	//Ball height as the player paddle sees it when the field is flipped upside down
+	int mirroredY(int y) const
+	{
+		return enemy.rect.y + player.rect.y - y;
+	}
+
+	int moveBall(int ticks, int& events)
+	{
+		//Ball will alternate on checking collision with player and enemy based on last one to hit the ball
+		int ballState = ball.move(ticks, playerHitBall ? enemy.rect : player.rect, events);
+		if (ballState == 1)
+		{
+			if (!playerHitBall)
+				score++;
+			playerHitBall = !playerHitBall;
+		}
+		return ballState;
+	}
+};
+
+static_assert(std::is_trivially_copyable<MatchState>::value && std::is_standard_layout<MatchState>::value,
+	"MatchState is saved and restored with memcpy");
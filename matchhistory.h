@@ -0,0 +1,62 @@
+#pragma once
+//Fixed ring of match snapshots, saving or restoring one is a single memcpy
+//The ring is preallocated with the object, so keeping a history never allocates during a match
+#include "match.h"
+#include <cstring>
+
+template <int CAPACITY>
+class MatchHistory
+{
+public:
+	static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+	MatchHistory()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		next = 0;
+		count = 0;
+	}
+
+	//Saves a snapshot, overwriting the oldest one once the ring is full
+	void save(const MatchState& match)
+	{
+		memcpy(&snapshots[next & (CAPACITY - 1)], &match, sizeof(MatchState));
+		next++;
+		if (count < CAPACITY)
+			count++;
+	}
+
+	//Restores the snapshot saved stepsBack saves ago, 0 being the latest, and drops the ones saved after it
+	//so saving continues from the restored state, returns false if the ring does not reach that far back
+	bool restore(int stepsBack, MatchState& match)
+	{
+		if (stepsBack < 0 || stepsBack >= count)
+			return false;
+		next -= stepsBack;
+		count -= stepsBack;
+		memcpy(&match, &snapshots[(next - 1) & (CAPACITY - 1)], sizeof(MatchState));
+		return true;
+	}
+
+	//Snapshot saved stepsBack saves ago without restoring it, NULL if the ring does not reach that far back
+	const MatchState* peek(int stepsBack) const
+	{
+		if (stepsBack < 0 || stepsBack >= count)
+			return NULL;
+		return &snapshots[(next - 1 - stepsBack) & (CAPACITY - 1)];
+	}
+
+	int size() const
+	{
+		return count;
+	}
+
+private:
+	MatchState snapshots[CAPACITY];
+	unsigned int next;
+	int count;
+};
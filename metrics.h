@@ -0,0 +1,287 @@
+#pragma once
+//Process-wide counters and latency histograms exported periodically in Prometheus text format
+//Recording only touches preallocated atomics, so it is lock-free and never allocates
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//Microseconds on a monotonic clock, used to time the hot path without going through SDL
+inline uint64_t metricsNowMicros()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Monotonic event counter
+class Counter
+{
+public:
+	Counter(const char* name, const char* help) : name(name), help(help), value(0) {}
+
+	void add(uint64_t n = 1)
+	{
+		value.fetch_add(n, std::memory_order_relaxed);
+	}
+	uint64_t get() const
+	{
+		return value.load(std::memory_order_relaxed);
+	}
+
+	const char* name;
+	const char* help;
+
+private:
+	std::atomic<uint64_t> value;
+};
+
+//High dynamic range histogram with log-linear buckets
+//Every power of two is split into SUB_BUCKETS linear buckets, which keeps the relative error
+//of any recorded value under 1/SUB_BUCKETS (about 3%) from 1 microsecond up to over an hour
+class Histogram
+{
+public:
+	static const int SUB_BITS = 5;
+	static const int SUB_BUCKETS = 1 << SUB_BITS;
+	static const int MAGNITUDES = 28;
+	static const int BUCKETS = SUB_BUCKETS * (MAGNITUDES + 1);
+
+	//Values are recorded as integers and multiplied by unit when exported, microseconds to seconds by default
+	Histogram(const char* name, const char* help, double unit = 1e-6) : name(name), help(help), unit(unit), sum(0)
+	{
+		for (int i = 0; i < BUCKETS; i++)
+			counts[i].store(0, std::memory_order_relaxed);
+	}
+
+	//Records a value, in microseconds for timings
+	void record(uint64_t value)
+	{
+		counts[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+		sum.fetch_add(value, std::memory_order_relaxed);
+	}
+
+	//Maps a value to its bucket, values that are too large land in the last bucket
+	static int bucketIndex(uint64_t value)
+	{
+		if (value < SUB_BUCKETS)
+			return (int)value;
+		int shift = highestBit(value) - SUB_BITS;
+		if (shift >= MAGNITUDES)
+			return BUCKETS - 1;
+		return SUB_BUCKETS * (shift + 1) + (int)((value >> shift) - SUB_BUCKETS);
+	}
+	//Largest value that falls into the given bucket
+	static uint64_t bucketUpperBound(int index)
+	{
+		if (index < SUB_BUCKETS)
+			return (uint64_t)index;
+		int shift = index / SUB_BUCKETS - 1;
+		uint64_t sub = (uint64_t)(index % SUB_BUCKETS) + SUB_BUCKETS;
+		return ((sub + 1) << shift) - 1;
+	}
+
+	//Copies the current bucket counts, used by the exporter only
+	void snapshot(uint64_t* out, uint64_t& outSum) const
+	{
+		for (int i = 0; i < BUCKETS; i++)
+			out[i] = counts[i].load(std::memory_order_relaxed);
+		outSum = sum.load(std::memory_order_relaxed);
+	}
+
+	const char* name;
+	const char* help;
+	double unit;
+
+private:
+	static int highestBit(uint64_t value)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return (int)index;
+#else
+		return 63 - __builtin_clzll(value);
+#endif
+	}
+
+	std::atomic<uint64_t> counts[BUCKETS];
+	std::atomic<uint64_t> sum;
+};
+
+//Records the lifetime of a scope into a histogram
+class ScopedTimer
+{
+public:
+	ScopedTimer(Histogram& histogram) : histogram(histogram), start(metricsNowMicros()) {}
+	~ScopedTimer()
+	{
+		histogram.record(metricsNowMicros() - start);
+	}
+
+private:
+	Histogram& histogram;
+	uint64_t start;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "metrics recording must be lock-free");
+
+//Every metric the game records, the order here is the order of the exported file
+struct Metrics
+{
+	Histogram frameTime{ "pong_frame_time_seconds", "Time between two consecutive presented frames" };
+	Histogram presentTime{ "pong_present_time_seconds", "Time spent in SDL_RenderPresent" };
+	Histogram updateScoreTime{ "pong_update_score_seconds", "Time spent reading and writing the high score file" };
+	Histogram frameAllocations{ "pong_frame_allocations", "Heap allocations made by the frame thread during one gameplay frame", 1.0 };
+	Counter collisions{ "pong_collisions_total", "Ball collisions with walls and paddles" };
+	Counter matchesPlayed{ "pong_matches_played_total", "Matches that reached a win or a loss" };
+	Counter soundsTriggered{ "pong_sounds_triggered_total", "Sound effects started with Mix_PlayChannel" };
+	Histogram aiDecisionTime{ "pong_ai_decision_seconds", "Time an asynchronous AI controller took to decide on one state" };
+	Counter aiStaleDecisions{ "pong_ai_stale_decisions_total", "Frames that moved the enemy with a decision made for an older state" };
+	Counter widgetStateChanges{ "pong_ui_widget_state_changes_total", "Widget hover and press state changes" };
+
+	Histogram* histograms[5] = { &frameTime, &presentTime, &updateScoreTime, &frameAllocations, &aiDecisionTime };
+	Counter* counters[5] = { &collisions, &matchesPlayed, &soundsTriggered, &aiStaleDecisions, &widgetStateChanges };
+};
+
+inline Metrics metrics;
+
+//Background thread that periodically writes every metric to a file in Prometheus text format
+//The file is written to a temporary path and renamed so a scraper never reads a partial file
+class MetricsExporter
+{
+public:
+	MetricsExporter()
+	{
+		running = false;
+		intervalSeconds = 10;
+	}
+	~MetricsExporter()
+	{
+		stop();
+	}
+
+	void start(const std::string& filePath, int interval)
+	{
+		stop();
+		path = filePath;
+		intervalSeconds = interval > 0 ? interval : 1;
+		//Bucket scratch space is allocated once here so the export loop stays allocation free as well
+		current.assign(Histogram::BUCKETS, 0);
+		previous.assign(sizeof(metrics.histograms) / sizeof(metrics.histograms[0]) * Histogram::BUCKETS, 0);
+		running = true;
+		worker = std::thread(&MetricsExporter::run, this);
+	}
+
+	//Stops the thread, writing the last values before returning
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!running)
+				return;
+			running = false;
+		}
+		wakeup.notify_one();
+		worker.join();
+	}
+
+private:
+	void run()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			wakeup.wait_for(lock, std::chrono::seconds(intervalSeconds), [this] { return !running; });
+			write();
+			if (!running)
+				break;
+		}
+	}
+
+	void write()
+	{
+		std::string tempPath = path + ".tmp";
+		FILE* file = fopen(tempPath.c_str(), "w");
+		if (file == NULL)
+			return;
+
+		for (Counter* counter : metrics.counters)
+		{
+			fprintf(file, "# HELP %s %s\n# TYPE %s counter\n", counter->name, counter->help, counter->name);
+			fprintf(file, "%s %llu\n", counter->name, (unsigned long long)counter->get());
+		}
+
+		int h = 0;
+		for (Histogram* histogram : metrics.histograms)
+		{
+			uint64_t sum;
+			histogram->snapshot(current.data(), sum);
+			uint64_t* last = previous.data() + h * Histogram::BUCKETS;
+			writeHistogram(file, *histogram, sum, last);
+			for (int i = 0; i < Histogram::BUCKETS; i++)
+				last[i] = current[i];
+			h++;
+		}
+
+		fclose(file);
+#ifdef _WIN32
+		remove(path.c_str());
+#endif
+		rename(tempPath.c_str(), path.c_str());
+	}
+
+	//Writes the cumulative histogram with a boundary at the end of every power of two, which lines up
+	//exactly with the bucket layout, followed by precise quantiles over the last interval so degradation shows up
+	//as a trend instead of being averaged into weeks of history
+	void writeHistogram(FILE* file, const Histogram& histogram, uint64_t sum, const uint64_t* last)
+	{
+		fprintf(file, "# HELP %s %s\n# TYPE %s histogram\n", histogram.name, histogram.help, histogram.name);
+		uint64_t cumulative = 0, intervalTotal = 0;
+		for (int i = 0; i < Histogram::BUCKETS; i++)
+		{
+			cumulative += current[i];
+			intervalTotal += current[i] - last[i];
+			uint64_t bound = Histogram::bucketUpperBound(i);
+			if (i < Histogram::BUCKETS - 1 && ((bound + 1) & bound) == 0)
+				fprintf(file, "%s_bucket{le=\"%.9g\"} %llu\n", histogram.name, bound * histogram.unit, (unsigned long long)cumulative);
+		}
+		fprintf(file, "%s_bucket{le=\"+Inf\"} %llu\n", histogram.name, (unsigned long long)cumulative);
+		fprintf(file, "%s_sum %.9g\n", histogram.name, sum * histogram.unit);
+		fprintf(file, "%s_count %llu\n", histogram.name, (unsigned long long)cumulative);
+
+		const double quantiles[] = { 0.5, 0.9, 0.99, 0.999, 1.0 };
+		fprintf(file, "# HELP %s_interval Quantiles over the last export interval\n# TYPE %s_interval gauge\n", histogram.name, histogram.name);
+		for (double q : quantiles)
+		{
+			uint64_t target = (uint64_t)(q * intervalTotal + 0.5), seen = 0;
+			uint64_t value = 0;
+			if (intervalTotal > 0)
+				for (int i = 0; i < Histogram::BUCKETS; i++)
+				{
+					seen += current[i] - last[i];
+					if (seen >= target && seen > 0)
+					{
+						value = Histogram::bucketUpperBound(i);
+						break;
+					}
+				}
+			fprintf(file, "%s_interval{quantile=\"%g\"} %.9g\n", histogram.name, q, value * histogram.unit);
+		}
+	}
+
+	std::string path;
+	int intervalSeconds;
+	bool running;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::thread worker;
+	std::vector<uint64_t> current, previous;
+};
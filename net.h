@@ -0,0 +1,146 @@
+#pragma once
+//Minimal non-blocking UDP socket over BSD sockets or Winsock
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef SOCKET SocketHandle;
+const SocketHandle INVALID_SOCKET_HANDLE = INVALID_SOCKET;
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int SocketHandle;
+const SocketHandle INVALID_SOCKET_HANDLE = -1;
+#endif
+
+//IPv4 address and port, both in host byte order
+struct NetAddress
+{
+	uint32_t ip;
+	uint16_t port;
+
+	bool operator==(const NetAddress& other) const
+	{
+		return ip == other.ip && port == other.port;
+	}
+
+	//Parses "a.b.c.d:port" or "localhost:port"
+	bool parse(const char* text)
+	{
+		char host[64];
+		unsigned int parsedPort;
+		if (sscanf(text, "%63[^:]:%u", host, &parsedPort) != 2 || parsedPort > 65535)
+			return false;
+		if (strcmp(host, "localhost") == 0)
+			strcpy(host, "127.0.0.1");
+		in_addr address;
+		if (inet_pton(AF_INET, host, &address) != 1)
+			return false;
+		ip = ntohl(address.s_addr);
+		port = (uint16_t)parsedPort;
+		return true;
+	}
+};
+
+class UdpSocket
+{
+public:
+	UdpSocket()
+	{
+		handle = INVALID_SOCKET_HANDLE;
+	}
+	~UdpSocket()
+	{
+		close();
+	}
+
+	//Opens a non-blocking socket bound to port, 0 picking any free port
+	//loopbackOnly restricts it to connections from this machine
+	bool open(uint16_t port, bool loopbackOnly)
+	{
+		close();
+#ifdef _WIN32
+		WSADATA data;
+		if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+			return false;
+#endif
+		handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+		if (handle == INVALID_SOCKET_HANDLE)
+			return false;
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+		//Room for a burst of small packets from many peers, the default buffer only holds a few hundred
+		int receiveBuffer = 1 << 20;
+		setsockopt(handle, SOL_SOCKET, SO_RCVBUF, (const char*)&receiveBuffer, sizeof(receiveBuffer));
+		if (bind(handle, (sockaddr*)&address, sizeof(address)) != 0)
+		{
+			close();
+			return false;
+		}
+#ifdef _WIN32
+		u_long nonBlocking = 1;
+		ioctlsocket(handle, FIONBIO, &nonBlocking);
+#else
+		fcntl(handle, F_SETFL, fcntl(handle, F_GETFL, 0) | O_NONBLOCK);
+#endif
+		return true;
+	}
+
+	void close()
+	{
+		if (handle == INVALID_SOCKET_HANDLE)
+			return;
+#ifdef _WIN32
+		closesocket(handle);
+		WSACleanup();
+#else
+		::close(handle);
+#endif
+		handle = INVALID_SOCKET_HANDLE;
+	}
+
+	bool send(const NetAddress& to, const void* data, int size)
+	{
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(to.port);
+		address.sin_addr.s_addr = htonl(to.ip);
+		return sendto(handle, (const char*)data, size, 0, (sockaddr*)&address, sizeof(address)) == size;
+	}
+
+	//Returns the size of the received packet, or -1 when no packet is waiting
+	int receive(void* data, int size, NetAddress& from)
+	{
+		sockaddr_in address;
+		socklen_t length = sizeof(address);
+		int received = (int)recvfrom(handle, (char*)data, size, 0, (sockaddr*)&address, &length);
+		if (received < 0)
+			return -1;
+		from.ip = ntohl(address.sin_addr.s_addr);
+		from.port = ntohs(address.sin_port);
+		return received;
+	}
+
+	//Port the socket is bound to, useful after opening it on port 0
+	uint16_t getPort()
+	{
+		sockaddr_in address;
+		socklen_t length = sizeof(address);
+		if (getsockname(handle, (sockaddr*)&address, &length) != 0)
+			return 0;
+		return ntohs(address.sin_port);
+	}
+
+private:
+	SocketHandle handle;
+};
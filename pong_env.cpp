@@ -0,0 +1,92 @@
+//Shared library exposing the match rules through the C interface in pong_env.h
+#define PONG_ENV_BUILD
+#include "pong_env.h"
+#include "match.h"
+#include <cstddef>
+#include <new>
+
+struct PongEnv
+{
+	int count;
+	int ticksPerStep;
+	MatchState* matches;
+};
+
+//Writes the observation of one match, see PONG_OBSERVATION_SIZE for the layout
+static void writeObservation(const MatchState& match, float* observation)
+{
+	observation[0] = (float)match.ball.posx;
+	observation[1] = (float)match.ball.posy;
+	observation[2] = (float)match.ball.velx;
+	observation[3] = (float)match.ball.vely;
+	observation[4] = (float)match.player.rect.x;
+	observation[5] = (float)match.enemy.rect.x;
+	observation[6] = match.playerHitBall ? 1.0f : 0.0f;
+	observation[7] = (float)match.score;
+}
+
+PongEnv* pong_env_create(int count, int ticksPerStep)
+{
+	if (count <= 0 || ticksPerStep <= 0)
+		return NULL;
+	PongEnv* env = new (std::nothrow) PongEnv;
+	if (env == NULL)
+		return NULL;
+	env->matches = new (std::nothrow) MatchState[count];
+	if (env->matches == NULL)
+	{
+		delete env;
+		return NULL;
+	}
+	env->count = count;
+	env->ticksPerStep = ticksPerStep;
+	for (int i = 0; i < count; i++)
+		env->matches[i].reset();
+	return env;
+}
+
+void pong_env_destroy(PongEnv* env)
+{
+	if (env == NULL)
+		return;
+	delete[] env->matches;
+	delete env;
+}
+
+int pong_env_count(const PongEnv* env)
+{
+	return env->count;
+}
+
+void pong_env_reset(PongEnv* env, float* observations)
+{
+	for (int i = 0; i < env->count; i++)
+	{
+		env->matches[i].reset();
+		writeObservation(env->matches[i], observations + i * PONG_OBSERVATION_SIZE);
+	}
+}
+
+void pong_env_step(PongEnv* env, const int* actions, float* observations, float* rewards, unsigned char* dones)
+{
+	for (int i = 0; i < env->count; i++)
+	{
+		MatchState& match = env->matches[i];
+		int events;
+		int ballState = match.step(env->ticksPerStep, actions[i], events);
+
+		//The match is over when the ball leaves the field, it is won if the player hit it last
+		if (ballState == -1)
+		{
+			rewards[i] = match.playerHitBall ? 1.0f : -1.0f;
+			dones[i] = 1;
+			match.reset();
+		}
+		else
+		{
+			rewards[i] = 0.0f;
+			dones[i] = 0;
+		}
+		writeObservation(match, observations + i * PONG_OBSERVATION_SIZE);
+	}
+}
@@ -0,0 +1,62 @@
+#ifndef PONG_ENV_H
+#define PONG_ENV_H
+/*
+ * C interface to a batch of headless pong matches, meant to be driven by training code in other processes
+ * Observations, rewards and done flags are written straight into buffers owned by the caller,
+ * so stepping never allocates
+ */
+
+#if defined(_WIN32)
+#if defined(PONG_ENV_BUILD)
+#define PONG_API __declspec(dllexport)
+#else
+#define PONG_API __declspec(dllimport)
+#endif
+#else
+#define PONG_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Floats written per environment into the observation buffer:
+ * ball x, ball y, ball x velocity, ball y velocity, player paddle x, enemy paddle x,
+ * 1 if the player was the last to hit the ball, current score
+ */
+#define PONG_OBSERVATION_SIZE 8
+
+/* Player actions */
+#define PONG_ACTION_LEFT -1
+#define PONG_ACTION_STAY 0
+#define PONG_ACTION_RIGHT 1
+
+typedef struct PongEnv PongEnv;
+
+/*
+ * Creates count independent matches, each step advancing the physics by ticksPerStep
+ * (the game uses a quarter of the frame duration in milliseconds, 4 at 60 FPS)
+ * Returns NULL if the arguments are invalid or memory could not be allocated
+ */
+PONG_API PongEnv* pong_env_create(int count, int ticksPerStep);
+PONG_API void pong_env_destroy(PongEnv* env);
+PONG_API int pong_env_count(const PongEnv* env);
+
+/* Resets every match and writes count * PONG_OBSERVATION_SIZE floats into observations */
+PONG_API void pong_env_reset(PongEnv* env, float* observations);
+
+/*
+ * Advances every match by one step
+ * actions holds count PONG_ACTION_* values, observations count * PONG_OBSERVATION_SIZE floats,
+ * rewards and dones count values each
+ * The reward is 1 when the player wins a match, -1 when it loses and 0 otherwise
+ * A finished match is reset immediately, its observation then being the first one of the next match
+ */
+PONG_API void pong_env_step(PongEnv* env, const int* actions, float* observations, float* rewards, unsigned char* dones);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,194 @@
+#pragma once
+//Screens of the game written as C++20 coroutines and driven by a single frame loop
+//Each frame the loop polls the events, resumes the scene waiting for the frame with them and presents,
+//so pacing, input, timing and metrics are the same on every screen and none of them can block the loop
+//
+//A scene renders its frame and then awaits the next one, awaiting another scene runs it as a sub-scene
+//until it returns, for example the menu awaits the match and the match awaits the pause screen
+#include <SDL.h>
+#include <coroutine>
+#include <exception>
+
+//Screen the game is on, passed along with every frame it waits for
+enum Scene
+{
+	SCENE_MENU, SCENE_PLAY, SCENE_PAUSED, SCENE_MATCH_OVER, SCENE_OPTIONS, SCENE_CREDITS, SCENE_HIGH_SCORE, SCENE_SPECTATE
+};
+
+//Events polled for one frame
+struct FrameEvents
+{
+	//Events beyond this stay queued for the next frame
+	static const int MAX_EVENTS = 64;
+
+	SDL_Event events[MAX_EVENTS];
+	int count = 0;
+
+	const SDL_Event* begin() const
+	{
+		return events;
+	}
+	const SDL_Event* end() const
+	{
+		return events + count;
+	}
+};
+
+//Coroutine of a scene, it starts suspended and runs once it is awaited or started by the scheduler
+class SceneTask
+{
+public:
+	struct promise_type
+	{
+		//Scene that awaited this one, resumed when this one returns
+		std::coroutine_handle<> continuation;
+
+		SceneTask get_return_object()
+		{
+			return SceneTask(std::coroutine_handle<promise_type>::from_promise(*this));
+		}
+		std::suspend_always initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> scene) noexcept
+			{
+				std::coroutine_handle<> continuation = scene.promise().continuation;
+				return continuation ? continuation : std::noop_coroutine();
+			}
+			void await_resume() noexcept
+			{
+			}
+		};
+		FinalAwaiter final_suspend() noexcept
+		{
+			return {};
+		}
+		void return_void()
+		{
+		}
+		void unhandled_exception()
+		{
+			std::terminate();
+		}
+	};
+
+	SceneTask(SceneTask&& other) noexcept : handle(other.handle)
+	{
+		other.handle = NULL;
+	}
+	SceneTask(const SceneTask&) = delete;
+	SceneTask& operator=(const SceneTask&) = delete;
+	~SceneTask()
+	{
+		if (handle)
+			handle.destroy();
+	}
+
+	bool isDone() const
+	{
+		return !handle || handle.done();
+	}
+
+	//Awaiting a scene runs it in place of the awaiting one until it returns
+	bool await_ready() const
+	{
+		return isDone();
+	}
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+	{
+		handle.promise().continuation = caller;
+		return handle;
+	}
+	void await_resume()
+	{
+	}
+
+private:
+	friend class SceneScheduler;
+
+	explicit SceneTask(std::coroutine_handle<promise_type> scene) : handle(scene)
+	{
+	}
+
+	std::coroutine_handle<promise_type> handle;
+};
+
+class SceneScheduler
+{
+public:
+	//Awaited by a scene to hand the frame back to the loop, resuming with the events of the next frame
+	struct FrameAwaiter
+	{
+		SceneScheduler* scheduler;
+		Scene scene;
+
+		bool await_ready() const
+		{
+			return false;
+		}
+		void await_suspend(std::coroutine_handle<> waitingScene)
+		{
+			scheduler->waiting = waitingScene;
+			scheduler->scene = scene;
+		}
+		const FrameEvents& await_resume() const
+		{
+			return *scheduler->events;
+		}
+	};
+
+	SceneScheduler()
+	{
+		root = NULL;
+		events = NULL;
+		scene = SCENE_MENU;
+	}
+
+	//Runs the root scene up to the first frame it waits for
+	void start(SceneTask& rootScene)
+	{
+		root = &rootScene;
+		waiting = rootScene.handle;
+		waiting.resume();
+	}
+
+	//The game is over once the root scene returned
+	bool isDone() const
+	{
+		return root == NULL || root->isDone();
+	}
+
+	//Scene waiting for the next frame
+	Scene getScene() const
+	{
+		return scene;
+	}
+
+	//Resumes the waiting scene with the events of this frame, it runs until it waits for the next one
+	void runFrame(const FrameEvents& frameEvents)
+	{
+		events = &frameEvents;
+		std::coroutine_handle<> resumed = waiting;
+		waiting = NULL;
+		resumed.resume();
+	}
+
+	FrameAwaiter nextFrame(Scene nextScene)
+	{
+		return { this, nextScene };
+	}
+
+private:
+	SceneTask* root;
+	std::coroutine_handle<> waiting;
+	const FrameEvents* events;
+	Scene scene;
+};
@@ -0,0 +1,397 @@
+#pragma once
+//Broadcasts the match to read-only spectators over UDP
+//Every snapshot is sent as a delta against the last state the spectator acknowledged, a spectator that
+//has not acknowledged anything yet (or fell too far behind) gets a keyframe, which is a delta against zero
+//
+//Spectator to host:  'H'                               join or keep waiting for the first snapshot
+//                    'A' seq(4)                        acknowledges the snapshot seq
+//Host to spectator:  'S' seq(4) base(4) mask(2) values snapshot seq encoded against base, 0 for a keyframe
+//Values are zigzag varints (see varint.h) of the difference to the base, one for each field set in mask
+#include "match.h"
+#include "net.h"
+#include "varint.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+enum SpectatorField
+{
+	FIELD_BALL_X, FIELD_BALL_Y, FIELD_BALL_VEL_X, FIELD_BALL_VEL_Y,
+	FIELD_PLAYER_X, FIELD_PLAYER_Y, FIELD_PLAYER_W, FIELD_PLAYER_H,
+	FIELD_ENEMY_X, FIELD_ENEMY_Y, FIELD_ENEMY_W, FIELD_ENEMY_H,
+	FIELD_SCORE, FIELD_PLAYER_HIT_BALL, FIELD_PHASE,
+	SPECTATOR_FIELD_COUNT
+};
+
+//What the host is showing, spectators only draw the field during a match
+enum SpectatorPhase
+{
+	PHASE_MENU = 0, PHASE_PLAY = 1, PHASE_OVER = 2
+};
+
+struct SpectatorState
+{
+	int32_t fields[SPECTATOR_FIELD_COUNT];
+};
+
+//Snapshots kept by both sides, acknowledgements older than this get a keyframe
+const int SPECTATOR_HISTORY = 64;
+const int SPECTATOR_MAX_PACKET = 11 + 5 * SPECTATOR_FIELD_COUNT;
+
+//Copies what spectators need to draw the match
+inline SpectatorState toSpectatorState(const MatchState& match, SpectatorPhase phase)
+{
+	SpectatorState state;
+	state.fields[FIELD_BALL_X] = match.ball.posx;
+	state.fields[FIELD_BALL_Y] = match.ball.posy;
+	state.fields[FIELD_BALL_VEL_X] = match.ball.velx;
+	state.fields[FIELD_BALL_VEL_Y] = match.ball.vely;
+	state.fields[FIELD_PLAYER_X] = match.player.rect.x;
+	state.fields[FIELD_PLAYER_Y] = match.player.rect.y;
+	state.fields[FIELD_PLAYER_W] = match.player.rect.w;
+	state.fields[FIELD_PLAYER_H] = match.player.rect.h;
+	state.fields[FIELD_ENEMY_X] = match.enemy.rect.x;
+	state.fields[FIELD_ENEMY_Y] = match.enemy.rect.y;
+	state.fields[FIELD_ENEMY_W] = match.enemy.rect.w;
+	state.fields[FIELD_ENEMY_H] = match.enemy.rect.h;
+	state.fields[FIELD_SCORE] = match.score;
+	state.fields[FIELD_PLAYER_HIT_BALL] = match.playerHitBall;
+	state.fields[FIELD_PHASE] = phase;
+	return state;
+}
+
+//Writes the snapshot packet for state encoded against base, returning its size
+inline int encodeSnapshot(uint8_t* out, uint32_t seq, uint32_t baseSeq, const SpectatorState& base, const SpectatorState& state)
+{
+	uint8_t* start = out;
+	*out++ = 'S';
+	out = writeU32(out, seq);
+	out = writeU32(out, baseSeq);
+	uint8_t* mask = out;
+	out += 2;
+	uint16_t changed = 0;
+	for (int i = 0; i < SPECTATOR_FIELD_COUNT; i++)
+	{
+		uint32_t delta = (uint32_t)state.fields[i] - (uint32_t)base.fields[i];
+		if (delta == 0)
+			continue;
+		changed |= 1 << i;
+		out = writeZigzag(out, (int32_t)delta);
+	}
+	mask[0] = (uint8_t)changed;
+	mask[1] = (uint8_t)(changed >> 8);
+	return (int)(out - start);
+}
+
+//Applies the values of a snapshot packet to a copy of its base, returning false if the packet is malformed
+inline bool decodeSnapshot(const uint8_t* in, int size, const SpectatorState& base, SpectatorState& state)
+{
+	const uint8_t* end = in + size;
+	if (size < 11)
+		return false;
+	uint16_t changed = (uint16_t)(in[9] | in[10] << 8);
+	in += 11;
+	state = base;
+	for (int i = 0; i < SPECTATOR_FIELD_COUNT; i++)
+	{
+		if (!(changed & (1 << i)))
+			continue;
+		int32_t delta;
+		in = readZigzag(in, end, delta);
+		if (in == NULL)
+			return false;
+		state.fields[i] = (int32_t)((uint32_t)base.fields[i] + (uint32_t)delta);
+	}
+	return true;
+}
+
+inline uint64_t spectatorNowMillis()
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//Sends every published state to the spectators that joined, keeping each one under a bandwidth budget
+class SpectatorHost
+{
+public:
+	static const int MAX_SPECTATORS = 512;
+	//Spectators that sent nothing for this long are dropped
+	static const uint64_t TIMEOUT_MILLIS = 5000;
+
+	SpectatorHost()
+	{
+		seq = 0;
+		clientCount = 0;
+		bytesPerSecond = 0;
+		lastPublish = 0;
+		bytesSent = 0;
+		memset(&zero, 0, sizeof(zero));
+		clearIndex();
+	}
+
+	//Listens on port, only on this machine unless allInterfaces is set
+	//Joining is unauthenticated and a spoofed join sends the budget to the spoofed address, so listening on
+	//every interface has to be asked for
+	bool start(uint16_t port, int budgetBytesPerSecond, bool allInterfaces = false)
+	{
+		bytesPerSecond = budgetBytesPerSecond;
+		lastPublish = spectatorNowMillis();
+		return socket.open(port, !allInterfaces);
+	}
+
+	//Handles joins and acknowledgements, then sends the new state to every spectator
+	void publish(const SpectatorState& state)
+	{
+		uint64_t now = spectatorNowMillis();
+		receive(now);
+		dropSilentClients(now);
+
+		seq++;
+		history[seq % SPECTATOR_HISTORY] = state;
+		historySeq[seq % SPECTATOR_HISTORY] = seq;
+
+		//Refill every budget with the time since the last publish, allowing a burst of half a second
+		uint64_t elapsed = now - lastPublish;
+		lastPublish = now;
+		int refill = (int)(elapsed * bytesPerSecond / 1000);
+
+		//Spectators acknowledging the same snapshot share one encoded packet
+		for (int i = 0; i < SPECTATOR_HISTORY; i++)
+			cachedFor[i] = 0;
+
+		for (int i = 0; i < clientCount; i++)
+		{
+			Client& client = clients[i];
+			client.tokens += refill;
+			if (client.tokens > bytesPerSecond / 2 + SPECTATOR_MAX_PACKET)
+				client.tokens = bytesPerSecond / 2 + SPECTATOR_MAX_PACKET;
+
+			uint32_t base = client.acked;
+			if (base == 0 || seq - base >= SPECTATOR_HISTORY || historySeq[base % SPECTATOR_HISTORY] != base)
+				base = 0;
+			int slot = base % SPECTATOR_HISTORY;
+			if (cachedFor[slot] != seq || cachedBase[slot] != base)
+			{
+				cachedSize[slot] = encodeSnapshot(cached[slot], seq, base, base == 0 ? zero : history[slot], state);
+				cachedFor[slot] = seq;
+				cachedBase[slot] = base;
+			}
+			//Out of budget, the next snapshot will carry this one's changes as well
+			if (client.tokens < cachedSize[slot])
+				continue;
+			client.tokens -= cachedSize[slot];
+			socket.send(client.address, cached[slot], cachedSize[slot]);
+			bytesSent += cachedSize[slot];
+		}
+	}
+
+	int getSpectatorCount()
+	{
+		return clientCount;
+	}
+	uint64_t getBytesSent()
+	{
+		return bytesSent;
+	}
+
+private:
+	struct Client
+	{
+		NetAddress address;
+		uint32_t acked;
+		uint64_t lastHeard;
+		int tokens;
+	};
+
+	static const int INDEX_SIZE = MAX_SPECTATORS * 2;
+
+	void receive(uint64_t now)
+	{
+		uint8_t packet[16];
+		NetAddress from;
+		int size;
+		while ((size = socket.receive(packet, sizeof(packet), from)) >= 0)
+		{
+			bool join = size == 1 && packet[0] == 'H';
+			bool ack = size == 5 && packet[0] == 'A';
+			if (!join && !ack)
+				continue;
+			//Acknowledgements from unknown addresses also join, so a spectator that timed out comes back by itself
+			int index = find(from);
+			if (index < 0)
+			{
+				if (clientCount == MAX_SPECTATORS)
+					continue;
+				index = clientCount++;
+				clients[index] = { from, 0, now, SPECTATOR_MAX_PACKET };
+				insertIndex(index);
+			}
+			clients[index].lastHeard = now;
+			if (ack)
+			{
+				uint32_t acked;
+				readU32(packet + 1, acked);
+				//Acknowledgements can arrive out of order, only move forward
+				if (acked <= seq && acked > clients[index].acked)
+					clients[index].acked = acked;
+			}
+		}
+	}
+
+	void dropSilentClients(uint64_t now)
+	{
+		int kept = 0;
+		for (int i = 0; i < clientCount; i++)
+			if (now - clients[i].lastHeard < TIMEOUT_MILLIS)
+				clients[kept++] = clients[i];
+		if (kept == clientCount)
+			return;
+		clientCount = kept;
+		clearIndex();
+		for (int i = 0; i < clientCount; i++)
+			insertIndex(i);
+	}
+
+	//Open addressing table from address to client, so packets are matched without scanning every client
+	static int hashAddress(const NetAddress& address)
+	{
+		uint32_t hash = address.ip * 2654435761u ^ address.port * 40503u;
+		return (int)(hash % INDEX_SIZE);
+	}
+	void clearIndex()
+	{
+		for (int i = 0; i < INDEX_SIZE; i++)
+			index[i] = -1;
+	}
+	void insertIndex(int client)
+	{
+		int slot = hashAddress(clients[client].address);
+		while (index[slot] >= 0)
+			slot = (slot + 1) % INDEX_SIZE;
+		index[slot] = client;
+	}
+	int find(const NetAddress& address)
+	{
+		for (int slot = hashAddress(address); index[slot] >= 0; slot = (slot + 1) % INDEX_SIZE)
+			if (clients[index[slot]].address == address)
+				return index[slot];
+		return -1;
+	}
+
+	UdpSocket socket;
+	uint32_t seq;
+	SpectatorState zero;
+	SpectatorState history[SPECTATOR_HISTORY];
+	uint32_t historySeq[SPECTATOR_HISTORY];
+	uint8_t cached[SPECTATOR_HISTORY][SPECTATOR_MAX_PACKET];
+	int cachedSize[SPECTATOR_HISTORY];
+	uint32_t cachedFor[SPECTATOR_HISTORY];
+	uint32_t cachedBase[SPECTATOR_HISTORY];
+	Client clients[MAX_SPECTATORS];
+	int clientCount;
+	int index[INDEX_SIZE];
+	int bytesPerSecond;
+	uint64_t lastPublish;
+	uint64_t bytesSent;
+};
+
+//Receives the match from a host, keeping the states it acknowledged to decode later deltas
+class SpectatorClient
+{
+public:
+	static const uint64_t ACK_INTERVAL_MILLIS = 50;
+
+	SpectatorClient()
+	{
+		latest = 0;
+		lastSent = 0;
+		memset(&zero, 0, sizeof(zero));
+		memset(&state, 0, sizeof(state));
+		for (int i = 0; i < SPECTATOR_HISTORY; i++)
+			historySeq[i] = 0;
+	}
+
+	bool connect(const char* address)
+	{
+		return host.parse(address) && socket.open(0, false);
+	}
+	bool connect(const NetAddress& address)
+	{
+		host = address;
+		return socket.open(0, false);
+	}
+
+	//Applies every snapshot waiting on the socket and acknowledges the newest one
+	//Returns true if the state changed
+	bool update()
+	{
+		uint8_t packet[SPECTATOR_MAX_PACKET];
+		NetAddress from;
+		int size;
+		bool changed = false;
+		while ((size = socket.receive(packet, sizeof(packet), from)) >= 0)
+		{
+			if (!(from == host) || size < 11 || packet[0] != 'S')
+				continue;
+			uint32_t seq, base;
+			readU32(packet + 1, seq);
+			readU32(packet + 5, base);
+			//Old snapshots and deltas against states this spectator never had are useless
+			if (seq <= latest)
+				continue;
+			if (base != 0 && historySeq[base % SPECTATOR_HISTORY] != base)
+				continue;
+			SpectatorState decoded;
+			if (!decodeSnapshot(packet, size, base == 0 ? zero : history[base % SPECTATOR_HISTORY], decoded))
+				continue;
+			latest = seq;
+			history[seq % SPECTATOR_HISTORY] = decoded;
+			historySeq[seq % SPECTATOR_HISTORY] = seq;
+			state = decoded;
+			changed = true;
+		}
+
+		//Acknowledging every few frames is enough to keep deltas small and cuts the host's incoming packets,
+		//without new snapshots the acknowledgement keeps the host from timing us out
+		uint64_t now = spectatorNowMillis();
+		if ((changed && now - lastSent >= ACK_INTERVAL_MILLIS) || now - lastSent >= 500)
+		{
+			uint8_t reply[5];
+			int replySize = 1;
+			reply[0] = 'H';
+			if (latest != 0)
+			{
+				reply[0] = 'A';
+				writeU32(reply + 1, latest);
+				replySize = 5;
+			}
+			socket.send(host, reply, replySize);
+			lastSent = now;
+		}
+		return changed;
+	}
+
+	bool hasState()
+	{
+		return latest != 0;
+	}
+	const SpectatorState& getState()
+	{
+		return state;
+	}
+	uint32_t getLatest()
+	{
+		return latest;
+	}
+
+private:
+	UdpSocket socket;
+	NetAddress host;
+	uint32_t latest;
+	uint64_t lastSent;
+	SpectatorState zero;
+	SpectatorState state;
+	SpectatorState history[SPECTATOR_HISTORY];
+	uint32_t historySeq[SPECTATOR_HISTORY];
+};
@@ -0,0 +1,255 @@
+#pragma once
+//Incremental hash of the match state and a compact trace of it, one record per simulation step
+//Two traces of the same inputs must be identical, tools/tracediff.cpp reports where they diverge
+//
+//Trace format: "PONGTRC1", then for every step the mask of fields that changed (2 bytes),
+//a zigzag varint of the change of each of those fields and the low 32 bits of the state hash (4 bytes)
+#include "match.h"
+#include "varint.h"
+#include <cstdio>
+#include <cstring>
+
+enum HashField
+{
+	HASH_BALL_X, HASH_BALL_Y, HASH_BALL_VEL_X, HASH_BALL_VEL_Y,
+	HASH_PLAYER_X, HASH_PLAYER_Y, HASH_PLAYER_W, HASH_PLAYER_H,
+	HASH_ENEMY_X, HASH_ENEMY_Y, HASH_ENEMY_W, HASH_ENEMY_H,
+	HASH_SCORE, HASH_PLAYER_HIT_BALL,
+	HASH_FIELD_COUNT
+};
+
+const char* const HASH_FIELD_NAMES[HASH_FIELD_COUNT] = {
+	"ball.posx", "ball.posy", "ball.velx", "ball.vely",
+	"player.x", "player.y", "player.w", "player.h",
+	"enemy.x", "enemy.y", "enemy.w", "enemy.h",
+	"score", "playerHitBall"
+};
+
+const char TRACE_MAGIC[8] = { 'P', 'O', 'N', 'G', 'T', 'R', 'C', '1' };
+const int TRACE_MAX_RECORD = 2 + 5 * HASH_FIELD_COUNT + 4;
+
+//What reading the next record of a trace found
+enum TraceRecord
+{
+	//The trace ended cleanly after the last complete record
+	TRACE_END,
+	TRACE_STEP,
+	//The file ends in the middle of a record or a varint in it is malformed
+	TRACE_TRUNCATED
+};
+
+inline void matchFields(const MatchState& match, int32_t* fields)
+{
+	fields[HASH_BALL_X] = match.ball.posx;
+	fields[HASH_BALL_Y] = match.ball.posy;
+	fields[HASH_BALL_VEL_X] = match.ball.velx;
+	fields[HASH_BALL_VEL_Y] = match.ball.vely;
+	fields[HASH_PLAYER_X] = match.player.rect.x;
+	fields[HASH_PLAYER_Y] = match.player.rect.y;
+	fields[HASH_PLAYER_W] = match.player.rect.w;
+	fields[HASH_PLAYER_H] = match.player.rect.h;
+	fields[HASH_ENEMY_X] = match.enemy.rect.x;
+	fields[HASH_ENEMY_Y] = match.enemy.rect.y;
+	fields[HASH_ENEMY_W] = match.enemy.rect.w;
+	fields[HASH_ENEMY_H] = match.enemy.rect.h;
+	fields[HASH_SCORE] = match.score;
+	fields[HASH_PLAYER_HIT_BALL] = match.playerHitBall;
+}
+
+//Mixes a field with its value, splitmix64 finalizer
+inline uint64_t hashField(int field, int32_t value)
+{
+	uint64_t x = ((uint64_t)field << 32 | (uint32_t)value) + 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+//The hash is the xor of every mixed field, so a step only rehashes the fields that changed
+class StateHasher
+{
+public:
+	StateHasher()
+	{
+		reset();
+	}
+
+	//Back to the all zero state
+	void reset()
+	{
+		hash = 0;
+		for (int i = 0; i < HASH_FIELD_COUNT; i++)
+		{
+			fields[i] = 0;
+			hash ^= hashField(i, 0);
+		}
+	}
+
+	//Brings the hash up to date with new field values, returning the mask of fields that changed
+	uint16_t update(const int32_t* next)
+	{
+		uint16_t changed = 0;
+		for (int i = 0; i < HASH_FIELD_COUNT; i++)
+			if (next[i] != fields[i])
+			{
+				hash ^= hashField(i, fields[i]) ^ hashField(i, next[i]);
+				fields[i] = next[i];
+				changed |= 1 << i;
+			}
+		return changed;
+	}
+
+	uint64_t getHash() const
+	{
+		return hash;
+	}
+	const int32_t* getFields() const
+	{
+		return fields;
+	}
+
+private:
+	int32_t fields[HASH_FIELD_COUNT];
+	uint64_t hash;
+};
+
+//Appends one record per step to a trace file
+class StateTraceWriter
+{
+public:
+	StateTraceWriter()
+	{
+		file = NULL;
+	}
+	~StateTraceWriter()
+	{
+		close();
+	}
+
+	bool open(const char* path)
+	{
+		close();
+		file = fopen(path, "wb");
+		if (file == NULL)
+			return false;
+		//Records are small, a large buffer keeps writes down to one every few thousand steps
+		setvbuf(file, NULL, _IOFBF, 1 << 16);
+		fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), file);
+		hasher.reset();
+		return true;
+	}
+
+	void close()
+	{
+		if (file != NULL)
+			fclose(file);
+		file = NULL;
+	}
+
+	bool isOpen() const
+	{
+		return file != NULL;
+	}
+
+	//Hashes the state after a step and writes its record, returning the hash
+	uint64_t record(const MatchState& match)
+	{
+		int32_t next[HASH_FIELD_COUNT];
+		int32_t previous[HASH_FIELD_COUNT];
+		matchFields(match, next);
+		memcpy(previous, hasher.getFields(), sizeof(previous));
+		uint16_t changed = hasher.update(next);
+		if (file == NULL)
+			return hasher.getHash();
+
+		uint8_t buffer[TRACE_MAX_RECORD];
+		uint8_t* out = buffer;
+		*out++ = (uint8_t)changed;
+		*out++ = (uint8_t)(changed >> 8);
+		for (int i = 0; i < HASH_FIELD_COUNT; i++)
+			if (changed & (1 << i))
+				out = writeZigzag(out, (int32_t)((uint32_t)next[i] - (uint32_t)previous[i]));
+		out = writeU32(out, (uint32_t)hasher.getHash());
+		fwrite(buffer, 1, out - buffer, file);
+		return hasher.getHash();
+	}
+
+private:
+	FILE* file;
+	StateHasher hasher;
+};
+
+//Reads a trace back one step at a time
+class StateTraceReader
+{
+public:
+	StateTraceReader()
+	{
+		file = NULL;
+		for (int i = 0; i < HASH_FIELD_COUNT; i++)
+			fields[i] = 0;
+		hash = 0;
+	}
+	~StateTraceReader()
+	{
+		if (file != NULL)
+			fclose(file);
+	}
+
+	bool open(const char* path)
+	{
+		file = fopen(path, "rb");
+		char magic[sizeof(TRACE_MAGIC)];
+		return file != NULL && fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+			&& memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+	}
+
+	TraceRecord next()
+	{
+		int low = fgetc(file);
+		if (low == EOF)
+			return TRACE_END;
+		int high = fgetc(file);
+		if (high == EOF)
+			return TRACE_TRUNCATED;
+		uint16_t changed = (uint16_t)(low | high << 8);
+		for (int i = 0; i < HASH_FIELD_COUNT; i++)
+			if (changed & (1 << i))
+			{
+				uint8_t bytes[5];
+				int length = 0;
+				int byte;
+				do
+				{
+					byte = fgetc(file);
+					if (byte == EOF || length == 5)
+						return TRACE_TRUNCATED;
+					bytes[length++] = (uint8_t)byte;
+				} while (byte & 0x80);
+				int32_t delta;
+				if (readZigzag(bytes, bytes + length, delta) == NULL)
+					return TRACE_TRUNCATED;
+				fields[i] = (int32_t)((uint32_t)fields[i] + (uint32_t)delta);
+			}
+		uint8_t bytes[4];
+		if (fread(bytes, 1, 4, file) != 4)
+			return TRACE_TRUNCATED;
+		readU32(bytes, hash);
+		return TRACE_STEP;
+	}
+
+	const int32_t* getFields() const
+	{
+		return fields;
+	}
+	//Hash stored in the trace for the last step read
+	uint32_t getHash() const
+	{
+		return hash;
+	}
+
+private:
+	FILE* file;
+	int32_t fields[HASH_FIELD_COUNT];
+	uint32_t hash;
+};
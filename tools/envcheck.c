@@ -0,0 +1,90 @@
+/*
+ * Smoke test of libpong_env through its C interface, written in C so it also checks the header compiles as C
+ * Runs a batch where even matches follow the ball and odd ones never move, and checks that rewards and
+ * done flags agree, that finished matches restart from the reset observation and that matches played
+ * with the same actions stay identical
+ * Exits with 0 when every check passes and 1 otherwise
+ *
+ * Build: g++ -std=c++17 -O2 -shared -fPIC -fvisibility=hidden ../pong_env.cpp -o libpong_env.so
+ *        gcc -std=c99 -O2 -I.. envcheck.c -L. -lpong_env -Wl,-rpath,. -o envcheck
+ */
+#include "pong_env.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNT 64
+#define STEPS 200000
+
+static int failures = 0;
+
+static void check(int condition, const char* what, int step, int match)
+{
+	if (condition)
+		return;
+	if (failures < 10)
+		printf("Step %d, match %d: %s\n", step, match, what);
+	failures++;
+}
+
+int main(void)
+{
+	static float observations[COUNT * PONG_OBSERVATION_SIZE], initial[PONG_OBSERVATION_SIZE];
+	static float rewards[COUNT];
+	static unsigned char dones[COUNT];
+	static int actions[COUNT];
+	int wins = 0, losses = 0, step, i;
+	PongEnv* env;
+
+	check(pong_env_create(0, 4) == NULL, "creating an empty batch succeeded", -1, -1);
+	check(pong_env_create(COUNT, 0) == NULL, "creating a batch with no ticks per step succeeded", -1, -1);
+	pong_env_destroy(NULL);
+
+	env = pong_env_create(COUNT, 4);
+	if (env == NULL)
+	{
+		printf("pong_env_create failed\n");
+		return 1;
+	}
+	check(pong_env_count(env) == COUNT, "wrong count", -1, -1);
+	pong_env_reset(env, observations);
+	memcpy(initial, observations, sizeof(initial));
+	for (i = 0; i < COUNT; i++)
+		check(memcmp(observations + i * PONG_OBSERVATION_SIZE, initial, sizeof(initial)) == 0, "reset observations differ", -1, i);
+
+	for (step = 0; step < STEPS; step++)
+	{
+		for (i = 0; i < COUNT; i++)
+		{
+			const float* observation = observations + i * PONG_OBSERVATION_SIZE;
+			/* Line the middle of the 80 pixel paddle up with the ball */
+			float offset = observation[0] - (observation[4] + 40.0f);
+			if (i & 1)
+				actions[i] = PONG_ACTION_STAY;
+			else
+				actions[i] = offset < -4.0f ? PONG_ACTION_LEFT : (offset > 4.0f ? PONG_ACTION_RIGHT : PONG_ACTION_STAY);
+		}
+		pong_env_step(env, actions, observations, rewards, dones);
+		for (i = 0; i < COUNT; i++)
+		{
+			const float* observation = observations + i * PONG_OBSERVATION_SIZE;
+			check(dones[i] == 0 || dones[i] == 1, "done is not 0 or 1", step, i);
+			check(dones[i] ? (rewards[i] == 1.0f || rewards[i] == -1.0f) : rewards[i] == 0.0f, "reward does not match done", step, i);
+			if (dones[i])
+				check(memcmp(observation, initial, sizeof(initial)) == 0, "finished match did not restart", step, i);
+			if (rewards[i] > 0.0f)
+				wins++;
+			else if (rewards[i] < 0.0f)
+				losses++;
+			/* Matches 0 and 1 are the reference for the others with the same policy */
+			check(memcmp(observation, observations + (i & 1) * PONG_OBSERVATION_SIZE, sizeof(initial)) == 0,
+				"match diverged from another played with the same actions", step, i);
+		}
+	}
+	pong_env_destroy(env);
+
+	check(wins + losses > 0, "no match finished", STEPS, -1);
+	printf("%d matches finished over %d steps of %d environments, %d won and %d lost, %d failed checks\n",
+		wins + losses, STEPS, COUNT, wins, losses, failures);
+	return failures == 0 ? 0 : 1;
+}
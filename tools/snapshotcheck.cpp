@@ -0,0 +1,116 @@
+//Checks rewinding and replaying AI vs AI matches from the snapshot ring
+//Each match is stepped, saving every step like the game does, then restored a random number of steps
+//back, compared by hash against the state at that step and replayed to the end with the same frame
+//durations, which has to reproduce the same hashes. Also times saving and restoring a snapshot
+//Exits with 0 when every match rewinds and replays exactly and 1 otherwise
+//
+//Build: g++ -std=c++17 -O2 -I.. snapshotcheck.cpp -o snapshotcheck
+#include "../match.h"
+#include "../matchhistory.h"
+#include "../statehash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+
+const int HISTORY = 256;
+const int MAX_STEPS = 4096;
+
+//Hash of one state on its own, independent of the states before it
+uint64_t hashState(const MatchState& match)
+{
+	int32_t fields[HASH_FIELD_COUNT];
+	matchFields(match, fields);
+	StateHasher hasher;
+	hasher.update(fields);
+	return hasher.getHash();
+}
+
+int main(int argc, char* args[])
+{
+	int matches = 1000, iterations = 10000000;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(args[i], "--matches") == 0)
+			matches = atoi(args[i + 1]);
+		else if (strcmp(args[i], "--iterations") == 0)
+			iterations = atoi(args[i + 1]);
+	}
+
+	std::mt19937_64 random(1);
+	AIParams playerAI, enemyAI;
+	static MatchHistory<HISTORY> history;
+	static int ticks[MAX_STEPS];
+	static uint64_t hashes[MAX_STEPS];
+	int failures = 0, rewound = 0;
+	for (int m = 0; m < matches; m++)
+	{
+		MatchState match;
+		match.reset();
+		match.ball.posx = 150 + (int)(random() % 300);
+		match.ball.velx = (random() & 1) ? match.ball.speed : -match.ball.speed;
+		history.clear();
+
+		//Step to the end of the match, remembering the frame durations and the hash after each step
+		int steps = 0, events;
+		bool over = false;
+		while (steps < MAX_STEPS && !over)
+		{
+			ticks[steps] = (12 + (int)(random() % 9)) >> 2;
+			over = match.stepAI(ticks[steps], playerAI, enemyAI, events) == -1;
+			history.save(match);
+			hashes[steps++] = hashState(match);
+		}
+
+		//Rewind somewhere within the ring
+		int back = (int)(random() % (uint64_t)(steps < HISTORY ? steps : HISTORY));
+		int step = steps - 1 - back;
+		const MatchState* peeked = history.peek(back);
+		if (peeked == NULL || hashState(*peeked) != hashes[step] || !history.restore(back, match) ||
+			hashState(match) != hashes[step] || history.size() != (steps < HISTORY ? steps : HISTORY) - back)
+		{
+			printf("Match %d: restoring %d steps back does not give the state of step %d\n", m, back, step);
+			failures++;
+			continue;
+		}
+
+		//Replay from the restored state, saving again on top of it
+		for (step++; step < steps; step++)
+		{
+			match.stepAI(ticks[step], playerAI, enemyAI, events);
+			history.save(match);
+			if (hashState(match) != hashes[step])
+			{
+				printf("Match %d: replay after restoring %d steps back diverges at step %d of %d\n", m, back, step, steps);
+				failures++;
+				break;
+			}
+		}
+		rewound += back;
+	}
+	printf("%d matches rewound %d steps in total, %d failed\n", matches, rewound, failures);
+
+	//volatile keeps the copies from being optimized away
+	MatchState match;
+	match.reset();
+	volatile int sink = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		match.score = i;
+		history.save(match);
+		sink = sink + match.score;
+	}
+	auto middle = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; i++)
+	{
+		history.restore(0, match);
+		sink = sink + match.score;
+	}
+	auto end = std::chrono::steady_clock::now();
+	printf("Snapshot of %d bytes: save %.1f ns, restore %.1f ns\n", (int)sizeof(MatchState),
+		std::chrono::duration<double, std::nano>(middle - start).count() / iterations,
+		std::chrono::duration<double, std::nano>(end - middle).count() / iterations);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+//Load test for the spectator broadcast
+//Runs a host simulating AI vs AI matches and hundreds of spectators on localhost in one process,
+//with spectators joining over time, then reports bandwidth per viewer, lag and whether every
+//spectator ended up with exactly the host's state
+//
+//Build: g++ -std=c++17 -O2 -I.. spectators.cpp -o spectators
+#include "../match.h"
+#include "../spectator.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <vector>
+
+int main(int argc, char* args[])
+{
+	int spectators = 300, seconds = 10, budget = 4096, port = 27960;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(args[i], "--spectators") == 0)
+			spectators = atoi(args[i + 1]);
+		else if (strcmp(args[i], "--seconds") == 0)
+			seconds = atoi(args[i + 1]);
+		else if (strcmp(args[i], "--budget") == 0)
+			budget = atoi(args[i + 1]);
+		else if (strcmp(args[i], "--port") == 0)
+			port = atoi(args[i + 1]);
+	}
+	spectators = std::min(spectators, SpectatorHost::MAX_SPECTATORS);
+
+	std::unique_ptr<SpectatorHost> host(new SpectatorHost);
+	if (!host->start((uint16_t)port, budget))
+	{
+		printf("Cannot open port %d\n", port);
+		return 1;
+	}
+	NetAddress address;
+	address.parse("127.0.0.1:0");
+	address.port = (uint16_t)port;
+	std::vector<std::unique_ptr<SpectatorClient>> clients;
+	for (int i = 0; i < spectators; i++)
+	{
+		clients.emplace_back(new SpectatorClient);
+		if (!clients.back()->connect(address))
+		{
+			printf("Cannot open spectator socket %d\n", i);
+			return 1;
+		}
+	}
+
+	MatchState match;
+	match.reset();
+	AIParams ai;
+	int frames = seconds * 60, matches = 0;
+	uint64_t lagSum = 0, lagSamples = 0, lagMax = 0;
+	SpectatorState state;
+	for (int frame = 0; frame < frames; frame++)
+	{
+		int events;
+		SpectatorPhase phase = PHASE_PLAY;
+		if (match.stepAI(4, ai, ai, events) == -1)
+		{
+			phase = PHASE_OVER;
+			matches++;
+		}
+		state = toSpectatorState(match, phase);
+		if (phase == PHASE_OVER)
+			match.reset();
+		host->publish(state);
+
+		//Spectators join gradually over the first half of the run, the late ones starting from a keyframe
+		int joined = (int)std::min<int64_t>(spectators, (int64_t)spectators * (frame + 1) * 2 / frames + 1);
+		for (int i = 0; i < joined; i++)
+		{
+			clients[i]->update();
+			if (frame >= frames / 2 && clients[i]->hasState())
+			{
+				uint32_t lag = (uint32_t)(frame + 1) - clients[i]->getLatest();
+				lagSum += lag;
+				lagSamples++;
+				lagMax = std::max<uint64_t>(lagMax, lag);
+			}
+		}
+		std::this_thread::sleep_for(std::chrono::microseconds(16667));
+	}
+
+	//Stop changing the state and let every spectator catch up
+	for (int round = 0; round < 30; round++)
+	{
+		host->publish(state);
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		for (int i = 0; i < spectators; i++)
+			clients[i]->update();
+	}
+	int synchronized = 0;
+	for (int i = 0; i < spectators; i++)
+		if (clients[i]->hasState() && memcmp(&clients[i]->getState(), &state, sizeof(state)) == 0)
+			synchronized++;
+
+	double bytesPerViewer = (double)host->getBytesSent() / std::max(1, spectators) / (seconds + 0.6);
+	printf("%d spectators connected, %d matches broadcast over %d s\n", host->getSpectatorCount(), matches, seconds);
+	printf("%.0f bytes/s per spectator (budget %d), %.1f bytes per snapshot\n", bytesPerViewer, budget, bytesPerViewer / 60.0);
+	printf("lag behind host: %.2f snapshots on average, %llu at most\n",
+		lagSamples ? (double)lagSum / lagSamples : 0.0, (unsigned long long)lagMax);
+	printf("%d of %d spectators match the host state\n", synchronized, spectators);
+	return synchronized == spectators ? 0 : 1;
+}
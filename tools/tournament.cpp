@@ -0,0 +1,465 @@
+//Self-play tournament between AI parameter sets
+//Schedules AI vs AI matches across every core with a work-stealing thread pool and rates each
+//parameter set with a Bradley-Terry fit reported on the Elo scale with 95% confidence intervals
+//Progress is appended to a checkpoint file so an interrupted run resumes where it stopped
+//
+//Build: g++ -std=c++17 -O2 -pthread -I.. tournament.cpp -o tournament
+#include "../match.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Options
+{
+	int speedMin = 2, speedMax = 5;
+	int shiftMin = 6, shiftMax = 8;
+	int randomCount = 0;
+	int ballSpeed = 2;
+	int rounds = 4;
+	int gamesPerTask = 16;
+	int maxFrames = 20000;
+	int threads = 0;
+	unsigned long long seed = 1;
+	std::string checkpoint;
+};
+
+//Outcome of one batch of games between two parameter sets, from the point of view of the first one
+struct TaskResult
+{
+	int wins, losses, draws;
+	bool done;
+};
+
+struct Task
+{
+	int a, b;
+	int round;
+};
+
+//Random number generator seeded from the run seed and the task so every task is reproducible
+//no matter which thread runs it or whether the run was resumed
+std::mt19937_64 taskRandom(unsigned long long seed, int task)
+{
+	std::seed_seq sequence{ (unsigned)seed, (unsigned)(seed >> 32), (unsigned)task };
+	return std::mt19937_64(sequence);
+}
+
+//Plays a single match, returning 1 if the parameters on the player side win, -1 if they lose and 0 on a draw
+//The serve and the frame durations are randomized so repeated games between the same pair differ
+int playMatch(const AIParams& playerAI, const AIParams& enemyAI, int ballSpeed, int maxFrames, std::mt19937_64& random)
+{
+	MatchState match;
+	match.reset();
+	match.ball.speed = ballSpeed;
+	match.ball.posx = 150 + (int)(random() % 300);
+	match.ball.velx = (random() & 1) ? ballSpeed : -ballSpeed;
+	match.ball.vely = ballSpeed;
+
+	int events;
+	for (int frame = 0; frame < maxFrames; frame++)
+	{
+		//Frame durations between 12 and 20 milliseconds, divided by 4 as the game does
+		int ticks = (12 + (int)(random() % 9)) >> 2;
+		if (match.stepAI(ticks, playerAI, enemyAI, events) == -1)
+			return match.playerHitBall ? 1 : -1;
+	}
+	return 0;
+}
+
+//Runs every game of a task, alternating which side of the field each parameter set plays on
+TaskResult runTask(const Task& task, int index, const std::vector<AIParams>& params, const Options& options)
+{
+	TaskResult result = { 0, 0, 0, true };
+	std::mt19937_64 random = taskRandom(options.seed, index);
+	for (int game = 0; game < options.gamesPerTask; game++)
+	{
+		int outcome;
+		if (game & 1)
+			outcome = -playMatch(params[task.b], params[task.a], options.ballSpeed, options.maxFrames, random);
+		else
+			outcome = playMatch(params[task.a], params[task.b], options.ballSpeed, options.maxFrames, random);
+		if (outcome > 0)
+			result.wins++;
+		else if (outcome < 0)
+			result.losses++;
+		else
+			result.draws++;
+	}
+	return result;
+}
+
+//Thread pool where each worker owns a deque of task indices, taking work from its back and
+//stealing from the front of other workers' deques once its own is empty
+//Matches vary a lot in length, stealing keeps every core busy until the very end of the run
+class WorkStealingPool
+{
+public:
+	WorkStealingPool(int workerCount) : queues(workerCount)
+	{
+		for (int i = 0; i < workerCount; i++)
+			queues[i].reset(new Queue);
+	}
+
+	void push(int worker, int task)
+	{
+		queues[worker]->tasks.push_back(task);
+	}
+
+	//Calls run(worker, task) for every task, returning once all of them finished
+	template <typename Function>
+	void run(Function function)
+	{
+		std::vector<std::thread> workers;
+		for (int i = 0; i < (int)queues.size(); i++)
+			workers.emplace_back([this, i, &function]
+				{
+					int task;
+					while (next(i, task))
+						function(i, task);
+				});
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+private:
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<int> tasks;
+	};
+
+	bool next(int worker, int& task)
+	{
+		{
+			Queue& own = *queues[worker];
+			std::lock_guard<std::mutex> lock(own.mutex);
+			if (!own.tasks.empty())
+			{
+				task = own.tasks.back();
+				own.tasks.pop_back();
+				return true;
+			}
+		}
+		//No task is ever added once the pool runs, so finding every queue empty means the work is done
+		for (int i = 1; i < (int)queues.size(); i++)
+		{
+			Queue& victim = *queues[(worker + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(victim.mutex);
+			if (!victim.tasks.empty())
+			{
+				task = victim.tasks.front();
+				victim.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	std::vector<std::unique_ptr<Queue>> queues;
+};
+
+//Describes the schedule, a checkpoint is only resumed by a run with the same signature
+std::string signature(const std::vector<AIParams>& params, const Options& options, int taskCount)
+{
+	std::string text = "pong-tournament 1 seed=" + std::to_string(options.seed) + " ball=" + std::to_string(options.ballSpeed)
+		+ " games=" + std::to_string(options.gamesPerTask) + " frames=" + std::to_string(options.maxFrames)
+		+ " tasks=" + std::to_string(taskCount) + " params=";
+	for (const AIParams& p : params)
+		text += std::to_string(p.speed) + "/" + std::to_string(p.distanceShift) + ",";
+	return text;
+}
+
+//Loads finished tasks from the checkpoint, returning false if it belongs to a different schedule
+bool loadCheckpoint(const std::string& path, const std::string& expected, std::vector<TaskResult>& results)
+{
+	FILE* file = fopen(path.c_str(), "r");
+	if (file == NULL)
+		return true;
+	std::vector<char> line(expected.size() + 64);
+	bool matches = fgets(line.data(), (int)line.size(), file) != NULL && expected + "\n" == line.data();
+	if (matches)
+	{
+		int task;
+		TaskResult result;
+		while (fscanf(file, "%d %d %d %d", &task, &result.wins, &result.losses, &result.draws) == 4)
+			if (task >= 0 && task < (int)results.size())
+			{
+				result.done = true;
+				results[task] = result;
+			}
+	}
+	fclose(file);
+	return matches;
+}
+
+struct Rating
+{
+	int index;
+	double elo, interval;
+	int games;
+	double points;
+};
+
+//Fits Bradley-Terry strengths with the minorization-maximization algorithm, counting a draw as half
+//a win for each side, and converts them to Elo with 95% intervals from the Fisher information
+//Every set also gets one virtual draw against every other set, which keeps ratings finite for
+//parameters that never lost or never won
+std::vector<Rating> rate(int count, const std::vector<Task>& tasks, const std::vector<TaskResult>& results)
+{
+	std::vector<double> wins(count * count, 0.0), games(count * count, 0.0);
+	for (int a = 0; a < count; a++)
+		for (int b = 0; b < count; b++)
+			if (a != b)
+			{
+				wins[a * count + b] = 0.5;
+				games[a * count + b] = 1.0;
+			}
+	std::vector<Rating> ratings(count);
+	for (int i = 0; i < count; i++)
+		ratings[i] = { i, 0.0, 0.0, 0, 0.0 };
+	for (int t = 0; t < (int)tasks.size(); t++)
+	{
+		if (!results[t].done)
+			continue;
+		int a = tasks[t].a, b = tasks[t].b;
+		double aPoints = results[t].wins + 0.5 * results[t].draws;
+		double bPoints = results[t].losses + 0.5 * results[t].draws;
+		int played = results[t].wins + results[t].losses + results[t].draws;
+		wins[a * count + b] += aPoints;
+		wins[b * count + a] += bPoints;
+		games[a * count + b] += played;
+		games[b * count + a] += played;
+		ratings[a].games += played; ratings[a].points += aPoints;
+		ratings[b].games += played; ratings[b].points += bPoints;
+	}
+
+	std::vector<double> strength(count, 1.0), next(count);
+	for (int iteration = 0; iteration < 1000; iteration++)
+	{
+		double change = 0.0, logSum = 0.0;
+		for (int i = 0; i < count; i++)
+		{
+			double totalWins = 0.0, denominator = 0.0;
+			for (int j = 0; j < count; j++)
+				if (i != j)
+				{
+					totalWins += wins[i * count + j];
+					denominator += games[i * count + j] / (strength[i] + strength[j]);
+				}
+			next[i] = totalWins / denominator;
+			logSum += std::log(next[i]);
+		}
+		//Normalize so the geometric mean strength is 1, which puts the average rating at 0
+		double scale = std::exp(logSum / count);
+		for (int i = 0; i < count; i++)
+		{
+			next[i] /= scale;
+			change = std::max(change, std::fabs(std::log(next[i] / strength[i])));
+			strength[i] = next[i];
+		}
+		if (change < 1e-9)
+			break;
+	}
+
+	const double eloScale = 400.0 / std::log(10.0);
+	for (int i = 0; i < count; i++)
+	{
+		double information = 0.0;
+		for (int j = 0; j < count; j++)
+			if (i != j)
+			{
+				double p = strength[i] / (strength[i] + strength[j]);
+				information += games[i * count + j] * p * (1.0 - p);
+			}
+		ratings[i].elo = eloScale * std::log(strength[i]);
+		ratings[i].interval = 1.96 * eloScale / std::sqrt(information);
+	}
+	std::sort(ratings.begin(), ratings.end(), [](const Rating& x, const Rating& y) { return x.elo > y.elo; });
+	return ratings;
+}
+
+bool parseRange(const char* text, int& low, int& high)
+{
+	if (sscanf(text, "%d:%d", &low, &high) == 2)
+		return low <= high;
+	if (sscanf(text, "%d", &low) == 1)
+	{
+		high = low;
+		return true;
+	}
+	return false;
+}
+
+void usage()
+{
+	printf("Usage: tournament [options]\n"
+		"  --speed MIN:MAX       AI base speed range (default 2:5)\n"
+		"  --shift MIN:MAX       AI distance coefficient shift range (default 6:8)\n"
+		"  --random N            sample N parameter sets from the ranges instead of the full grid\n"
+		"  --ball-speed N        ball speed used in every match (default 2)\n"
+		"  --rounds N            times every pair of parameter sets meets (default 4)\n"
+		"  --games N             games played each time a pair meets (default 16)\n"
+		"  --max-frames N        frames after which a match is a draw (default 20000)\n"
+		"  --threads N           worker threads (default: every core)\n"
+		"  --seed N              seed for sampling and matches (default 1)\n"
+		"  --checkpoint FILE     append progress to FILE and resume from it\n");
+}
+
+int main(int argc, char* args[])
+{
+	Options options;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = args[i];
+		const char* value = i + 1 < argc ? args[i + 1] : NULL;
+		bool valid = value != NULL;
+		if (strcmp(arg, "--help") == 0)
+		{
+			usage();
+			return 0;
+		}
+		else if (valid && strcmp(arg, "--speed") == 0)
+			valid = parseRange(value, options.speedMin, options.speedMax);
+		else if (valid && strcmp(arg, "--shift") == 0)
+			valid = parseRange(value, options.shiftMin, options.shiftMax);
+		else if (valid && strcmp(arg, "--random") == 0)
+			options.randomCount = atoi(value);
+		else if (valid && strcmp(arg, "--ball-speed") == 0)
+			options.ballSpeed = atoi(value);
+		else if (valid && strcmp(arg, "--rounds") == 0)
+			options.rounds = atoi(value);
+		else if (valid && strcmp(arg, "--games") == 0)
+			options.gamesPerTask = atoi(value);
+		else if (valid && strcmp(arg, "--max-frames") == 0)
+			options.maxFrames = atoi(value);
+		else if (valid && strcmp(arg, "--threads") == 0)
+			options.threads = atoi(value);
+		else if (valid && strcmp(arg, "--seed") == 0)
+			options.seed = strtoull(value, NULL, 10);
+		else if (valid && strcmp(arg, "--checkpoint") == 0)
+			options.checkpoint = value;
+		else
+			valid = false;
+		if (!valid)
+		{
+			usage();
+			return 1;
+		}
+		i++;
+	}
+	if (options.threads <= 0)
+		options.threads = std::max(1u, std::thread::hardware_concurrency());
+
+	//Parameter sets, either the full grid or a random sample of it
+	std::vector<AIParams> params;
+	if (options.randomCount > 0)
+	{
+		std::mt19937_64 random = taskRandom(options.seed, -1);
+		for (int i = 0; i < options.randomCount; i++)
+		{
+			AIParams p;
+			p.speed = options.speedMin + (int)(random() % (options.speedMax - options.speedMin + 1));
+			p.distanceShift = options.shiftMin + (int)(random() % (options.shiftMax - options.shiftMin + 1));
+			params.push_back(p);
+		}
+	}
+	else
+		for (int speed = options.speedMin; speed <= options.speedMax; speed++)
+			for (int shift = options.shiftMin; shift <= options.shiftMax; shift++)
+			{
+				AIParams p;
+				p.speed = speed;
+				p.distanceShift = shift;
+				params.push_back(p);
+			}
+	if (params.size() < 2)
+	{
+		printf("At least two parameter sets are needed\n");
+		return 1;
+	}
+
+	//Round robin schedule, each task being one batch of games between a pair
+	std::vector<Task> tasks;
+	for (int round = 0; round < options.rounds; round++)
+		for (int a = 0; a < (int)params.size(); a++)
+			for (int b = a + 1; b < (int)params.size(); b++)
+				tasks.push_back({ a, b, round });
+	std::vector<TaskResult> results(tasks.size(), TaskResult{ 0, 0, 0, false });
+
+	FILE* checkpoint = NULL;
+	std::string header = signature(params, options, (int)tasks.size());
+	if (!options.checkpoint.empty())
+	{
+		if (!loadCheckpoint(options.checkpoint, header, results))
+		{
+			printf("Checkpoint %s was written for a different schedule\n", options.checkpoint.c_str());
+			return 1;
+		}
+		bool fresh = std::none_of(results.begin(), results.end(), [](const TaskResult& r) { return r.done; });
+		checkpoint = fopen(options.checkpoint.c_str(), fresh ? "w" : "a");
+		if (checkpoint == NULL)
+		{
+			printf("Could not open checkpoint %s\n", options.checkpoint.c_str());
+			return 1;
+		}
+		if (fresh)
+		{
+			fprintf(checkpoint, "%s\n", header.c_str());
+			fflush(checkpoint);
+		}
+	}
+
+	//Deal the remaining tasks round robin, stealing evens out whatever imbalance is left
+	WorkStealingPool pool(options.threads);
+	int remaining = 0;
+	for (int t = 0; t < (int)tasks.size(); t++)
+		if (!results[t].done)
+			pool.push(remaining++ % options.threads, t);
+	printf("%d parameter sets, %d of %d tasks left, %d games each, %d threads\n",
+		(int)params.size(), remaining, (int)tasks.size(), options.gamesPerTask, options.threads);
+
+	std::mutex checkpointMutex;
+	std::atomic<int> finished(0);
+	auto start = std::chrono::steady_clock::now();
+	pool.run([&](int, int t)
+		{
+			//Each task writes only its own slot, the checkpoint file is the only shared resource
+			results[t] = runTask(tasks[t], t, params, options);
+			int count = ++finished;
+			if (checkpoint != NULL)
+			{
+				std::lock_guard<std::mutex> lock(checkpointMutex);
+				fprintf(checkpoint, "%d %d %d %d\n", t, results[t].wins, results[t].losses, results[t].draws);
+				if (count % 64 == 0 || count == remaining)
+					fflush(checkpoint);
+			}
+			//Every count is reached by exactly one task, so whichever worker crosses a multiple reports it
+			if (count % 256 == 0)
+				printf("%d / %d tasks\n", count, remaining);
+		});
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (checkpoint != NULL)
+		fclose(checkpoint);
+	printf("Played %lld matches in %.2f s\n", (long long)remaining * options.gamesPerTask, seconds);
+
+	std::vector<Rating> ratings = rate((int)params.size(), tasks, results);
+	printf("\n%4s %6s %6s %8s %8s %7s\n", "rank", "speed", "shift", "elo", "95%", "score");
+	for (int i = 0; i < (int)ratings.size(); i++)
+	{
+		const Rating& r = ratings[i];
+		printf("%4d %6d %6d %8.1f %8.1f %6.1f%%\n", i + 1, params[r.index].speed, params[r.index].distanceShift,
+			r.elo, r.interval, r.games > 0 ? 100.0 * r.points / r.games : 0.0);
+	}
+	return 0;
+}
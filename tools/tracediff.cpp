@@ -0,0 +1,70 @@
+//Compares two state traces written with --trace and reports the first step where they diverge
+//Exits with 0 when the traces are identical, 1 when they diverge and 2 when a trace cannot be read
+//
+//Build: g++ -std=c++17 -O2 -I.. tracediff.cpp -o tracediff
+#include "../statehash.h"
+#include <stdio.h>
+#include <string.h>
+
+//Checks the stored hash against one recomputed from the fields, catching corrupted traces
+bool verify(StateHasher& hasher, const StateTraceReader& trace)
+{
+	hasher.update(trace.getFields());
+	return (uint32_t)hasher.getHash() == trace.getHash();
+}
+
+int main(int argc, char* args[])
+{
+	if (argc != 3)
+	{
+		printf("Usage: tracediff <trace> <trace>\n");
+		return 2;
+	}
+	StateTraceReader traces[2];
+	StateHasher hashers[2];
+	for (int i = 0; i < 2; i++)
+		if (!traces[i].open(args[i + 1]))
+		{
+			printf("%s is not a state trace\n", args[i + 1]);
+			return 2;
+		}
+
+	for (long long step = 0;; step++)
+	{
+		TraceRecord records[2] = { traces[0].next(), traces[1].next() };
+		for (int i = 0; i < 2; i++)
+			if (records[i] == TRACE_TRUNCATED)
+			{
+				printf("%s is corrupted at step %lld, its last record is cut short\n", args[i + 1], step);
+				return 2;
+			}
+		bool more[2] = { records[0] == TRACE_STEP, records[1] == TRACE_STEP };
+		if (!more[0] || !more[1])
+		{
+			if (more[0] == more[1])
+			{
+				printf("Traces are identical over %lld steps\n", step);
+				return 0;
+			}
+			printf("%s ends at step %lld, the other trace continues\n", args[more[0] ? 2 : 1], step);
+			return 1;
+		}
+		for (int i = 0; i < 2; i++)
+			if (!verify(hashers[i], traces[i]))
+			{
+				printf("%s is corrupted at step %lld\n", args[i + 1], step);
+				return 2;
+			}
+		if (traces[0].getHash() == traces[1].getHash()
+			&& memcmp(traces[0].getFields(), traces[1].getFields(), sizeof(int32_t) * HASH_FIELD_COUNT) == 0)
+			continue;
+
+		printf("First divergence at step %lld\n", step);
+		const int32_t* a = traces[0].getFields();
+		const int32_t* b = traces[1].getFields();
+		for (int f = 0; f < HASH_FIELD_COUNT; f++)
+			if (a[f] != b[f])
+				printf("  %-14s %11d %11d\n", HASH_FIELD_NAMES[f], a[f], b[f]);
+		return 1;
+	}
+}
@@ -0,0 +1,114 @@
+//Checks the hit-test grid of the UI layer against a linear scan over every widget
+//Builds random layouts of overlapping widgets, partly off screen as well, and clicks random points,
+//points on widget edges and points outside the screen, expecting the grid to pick the same widget as
+//the first registered one containing the point
+//Also checks the dirty mask marks exactly the widgets whose state a click changed
+//Exits with 0 when every click matches and 1 otherwise
+//
+//Build: g++ -std=c++17 -O2 -pthread -I.. $(sdl2-config --cflags) uicheck.cpp -o uicheck
+#include "../ui.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <random>
+
+//Widget the layer should report, the first one registered containing the point, edges included
+int linearHitTest(const SDL_Rect* rects, int count, int x, int y)
+{
+	if (x < 0 || y < 0 || x >= SCREEN_WIDTH || y >= SCREEN_HEIGHT)
+		return -1;
+	for (int i = 0; i < count; i++)
+		if (x >= rects[i].x && x <= rects[i].x + rects[i].w && y >= rects[i].y && y <= rects[i].y + rects[i].h)
+			return i;
+	return -1;
+}
+
+int main(int argc, char* args[])
+{
+	int layouts = 2000, clicks = 1000;
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(args[i], "--layouts") == 0)
+			layouts = atoi(args[i + 1]);
+		else if (strcmp(args[i], "--clicks") == 0)
+			clicks = atoi(args[i + 1]);
+	}
+
+	std::mt19937 random(1);
+	auto between = [&](int low, int high)
+	{
+		return low + (int)(random() % (unsigned)(high - low + 1));
+	};
+	long long failures = 0;
+	for (int l = 0; l < layouts; l++)
+	{
+		//No more widgets than a cell holds, so any overlap is valid
+		UILayer layer;
+		SDL_Rect rects[UILayer::CELL_CAPACITY];
+		int count = between(1, UILayer::CELL_CAPACITY);
+		for (int i = 0; i < count; i++)
+		{
+			rects[i] = { between(-100, SCREEN_WIDTH), between(-100, SCREEN_HEIGHT), between(1, 300), between(1, 120) };
+			if (layer.add(rects[i]) != i)
+			{
+				printf("Layout %d: widget %d got another id\n", l, i);
+				return 1;
+			}
+		}
+		layer.reset(-1, -1);
+		if (layer.getDirty() != ((uint64_t)1 << count) - 1)
+		{
+			printf("Layout %d: reset did not mark every widget dirty\n", l);
+			failures++;
+		}
+		WidgetState states[UILayer::CELL_CAPACITY];
+		for (int i = 0; i < count; i++)
+			states[i] = layer.getState(i);
+
+		for (int c = 0; c < clicks; c++)
+		{
+			int x, y;
+			if (c & 1)
+			{
+				//Corners and edges of a widget, one pixel either side of them included
+				const SDL_Rect& rect = rects[between(0, count - 1)];
+				x = rect.x + (between(0, 1) ? rect.w : 0) + between(-1, 1);
+				y = rect.y + (between(0, 1) ? rect.h : 0) + between(-1, 1);
+			}
+			else
+			{
+				x = between(-50, SCREEN_WIDTH + 50);
+				y = between(-50, SCREEN_HEIGHT + 50);
+			}
+			layer.clearDirty();
+			SDL_Event event;
+			memset(&event, 0, sizeof(event));
+			event.type = SDL_MOUSEBUTTONDOWN;
+			event.button.x = x;
+			event.button.y = y;
+			int clicked = layer.handleEvent(event).clicked, expected = linearHitTest(rects, count, x, y);
+			if (clicked != expected)
+			{
+				if (failures < 10)
+					printf("Layout %d: click at %d, %d hit widget %d instead of %d\n", l, x, y, clicked, expected);
+				failures++;
+			}
+			uint64_t changed = 0;
+			for (int i = 0; i < count; i++)
+				if (layer.getState(i) != states[i])
+				{
+					changed |= (uint64_t)1 << i;
+					states[i] = layer.getState(i);
+				}
+			if (layer.getDirty() != changed)
+			{
+				if (failures < 10)
+					printf("Layout %d: click at %d, %d left dirty mask %llx instead of %llx\n", l, x, y,
+						(unsigned long long)layer.getDirty(), (unsigned long long)changed);
+				failures++;
+			}
+		}
+	}
+	printf("%lld clicks on %d layouts, %lld did not match the linear scan or the dirty mask\n", (long long)layouts * clicks, layouts, failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+#pragma once
+//Retained-mode layer of the clickable widgets of one screen
+//Widgets are registered once with their rectangle and found through a coarse grid over the screen,
+//so an event costs one cell lookup and a few rectangle tests however many widgets the screen has
+//The layer keeps the hover and press state of every widget and marks the ones whose state changed as needing
+//a redraw. The SDL screens redraw everything each frame since the back buffer is undefined after a present,
+//the dirty mask is for renderers that keep their frame, such as a cached render target or a partial update
+#include <SDL.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include "match.h"
+#include "metrics.h"
+
+//Matches the order of the button sprites
+enum WidgetState
+{
+	WIDGET_NORMAL, WIDGET_HOVER, WIDGET_PRESSED
+};
+
+//What an event did to the widgets, -1 where it did nothing
+struct UIInput
+{
+	//Widget the mouse moved onto
+	int entered;
+	//Widget clicked with the mouse or with space while hovering it
+	int clicked;
+};
+
+class UILayer
+{
+public:
+	static const int MAX_WIDGETS = 64;
+	static const int CELL_SIZE = 50;
+	//Widgets overlapping one cell, far more than any screen stacks in 50 pixels
+	static const int CELL_CAPACITY = 8;
+	static const int GRID_COLUMNS = (SCREEN_WIDTH + CELL_SIZE - 1) / CELL_SIZE;
+	static const int GRID_ROWS = (SCREEN_HEIGHT + CELL_SIZE - 1) / CELL_SIZE;
+
+	UILayer()
+	{
+		count = 0;
+		for (int row = 0; row < GRID_ROWS; row++)
+			for (int column = 0; column < GRID_COLUMNS; column++)
+				cellCounts[row][column] = 0;
+		reset(-1, -1);
+	}
+
+	//Registers a widget and returns its id, where widgets overlap the one registered first gets the mouse
+	//Screens are laid out once at startup, so a layer or cell running full is a layout bug and aborts right away
+	int add(const SDL_Rect& rect)
+	{
+		if (count == MAX_WIDGETS)
+			full("layer");
+		int firstColumn = clampColumn(rect.x), lastColumn = clampColumn(rect.x + rect.w);
+		int firstRow = clampRow(rect.y), lastRow = clampRow(rect.y + rect.h);
+		for (int row = firstRow; row <= lastRow; row++)
+			for (int column = firstColumn; column <= lastColumn; column++)
+				if (cellCounts[row][column] == CELL_CAPACITY)
+					full("grid cell");
+		int id = count++;
+		rects[id] = rect;
+		states[id] = WIDGET_NORMAL;
+		for (int row = firstRow; row <= lastRow; row++)
+			for (int column = firstColumn; column <= lastColumn; column++)
+				cells[row][column][cellCounts[row][column]++] = (uint8_t)id;
+		dirty |= (uint64_t)1 << id;
+		return id;
+	}
+
+	//Called when the screen is entered with the mouse position, every widget starts out normal and needs drawing
+	void reset(int x, int y)
+	{
+		for (int i = 0; i < count; i++)
+			states[i] = WIDGET_NORMAL;
+		hovered = -1;
+		mouseX = x;
+		mouseY = y;
+		dirty = count == MAX_WIDGETS ? ~(uint64_t)0 : ((uint64_t)1 << count) - 1;
+	}
+
+	//Mouse events carry their position, any other event reuses the last one
+	UIInput handleEvent(const SDL_Event& event)
+	{
+		UIInput input = { -1, -1 };
+		if (event.type == SDL_MOUSEMOTION)
+		{
+			mouseX = event.motion.x;
+			mouseY = event.motion.y;
+		}
+		else if (event.type == SDL_MOUSEBUTTONDOWN || event.type == SDL_MOUSEBUTTONUP)
+		{
+			mouseX = event.button.x;
+			mouseY = event.button.y;
+		}
+		int hit = hitTest(mouseX, mouseY);
+		bool wasHovered = hit >= 0 && hit == hovered;
+		if (hovered >= 0 && hit != hovered)
+			setState(hovered, WIDGET_NORMAL);
+		hovered = hit;
+		if (hit < 0)
+			return input;
+
+		switch (event.type)
+		{
+		case SDL_MOUSEMOTION:
+			setState(hit, WIDGET_HOVER);
+			if (!wasHovered)
+				input.entered = hit;
+			break;
+		case SDL_MOUSEBUTTONDOWN:
+			setState(hit, WIDGET_PRESSED);
+			input.clicked = hit;
+			break;
+		case SDL_KEYDOWN:
+			if (event.key.keysym.sym == SDLK_SPACE && !event.key.repeat)
+			{
+				setState(hit, WIDGET_PRESSED);
+				input.clicked = hit;
+			}
+			break;
+		}
+		return input;
+	}
+
+	WidgetState getState(int id) const
+	{
+		return states[id];
+	}
+
+	//Bit i is set when widget i needs a redraw, since it was added, the layer was reset or its state changed,
+	//until the caller clears the mask after redrawing
+	uint64_t getDirty() const
+	{
+		return dirty;
+	}
+	void clearDirty()
+	{
+		dirty = 0;
+	}
+
+private:
+	[[noreturn]] void full(const char* what) const
+	{
+		//stderr so the message is not lost in the stdout buffer on abort
+		fprintf(stderr, "UI %s is full, cannot add widget %d\n", what, count);
+		abort();
+	}
+
+	int clampColumn(int x) const
+	{
+		return x < 0 ? 0 : (x / CELL_SIZE >= GRID_COLUMNS ? GRID_COLUMNS - 1 : x / CELL_SIZE);
+	}
+	int clampRow(int y) const
+	{
+		return y < 0 ? 0 : (y / CELL_SIZE >= GRID_ROWS ? GRID_ROWS - 1 : y / CELL_SIZE);
+	}
+
+	//Widget under a point, edges included, -1 for none
+	int hitTest(int x, int y) const
+	{
+		if (x < 0 || y < 0 || x / CELL_SIZE >= GRID_COLUMNS || y / CELL_SIZE >= GRID_ROWS)
+			return -1;
+		//Cells list their widgets in the order they were registered
+		const uint8_t* cell = cells[y / CELL_SIZE][x / CELL_SIZE];
+		for (int i = 0; i < cellCounts[y / CELL_SIZE][x / CELL_SIZE]; i++)
+		{
+			const SDL_Rect& rect = rects[cell[i]];
+			if (x >= rect.x && x <= rect.x + rect.w && y >= rect.y && y <= rect.y + rect.h)
+				return cell[i];
+		}
+		return -1;
+	}
+
+	void setState(int id, WidgetState state)
+	{
+		if (states[id] == state)
+			return;
+		states[id] = state;
+		dirty |= (uint64_t)1 << id;
+		metrics.widgetStateChanges.add();
+	}
+
+	int count;
+	SDL_Rect rects[MAX_WIDGETS];
+	WidgetState states[MAX_WIDGETS];
+	uint8_t cells[GRID_ROWS][GRID_COLUMNS][CELL_CAPACITY];
+	uint8_t cellCounts[GRID_ROWS][GRID_COLUMNS];
+	int hovered;
+	int mouseX, mouseY;
+	uint64_t dirty;
+};
@@ -0,0 +1,49 @@
+#pragma once
+//Variable length integers shared by the network and trace formats
+//Zigzag encoding keeps small negative numbers small, varint then stores them in as few bytes as possible
+#include <cstddef>
+#include <cstdint>
+
+//Writes at most 5 bytes, returning the end of the written data
+inline uint8_t* writeZigzag(uint8_t* out, int32_t value)
+{
+	uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+	while (zigzag >= 0x80)
+	{
+		*out++ = (uint8_t)(zigzag | 0x80);
+		zigzag >>= 7;
+	}
+	*out++ = (uint8_t)zigzag;
+	return out;
+}
+
+//Returns the end of the read data, or NULL if the value runs past end
+inline const uint8_t* readZigzag(const uint8_t* in, const uint8_t* end, int32_t& value)
+{
+	uint32_t zigzag = 0;
+	for (int shift = 0;; shift += 7)
+	{
+		if (in == end || shift > 28)
+			return NULL;
+		uint8_t byte = *in++;
+		zigzag |= (uint32_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+			break;
+	}
+	value = (int32_t)((zigzag >> 1) ^ (0u - (zigzag & 1)));
+	return in;
+}
+
+inline uint8_t* writeU32(uint8_t* out, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		*out++ = (uint8_t)(value >> (8 * i));
+	return out;
+}
+inline const uint8_t* readU32(const uint8_t* in, uint32_t& value)
+{
+	value = 0;
+	for (int i = 0; i < 4; i++)
+		value |= (uint32_t)*in++ << (8 * i);
+	return in;
+}